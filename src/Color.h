@@ -1,6 +1,7 @@
 #pragma once
 
 #include "common.h"
+#include <array>
 
 template<typename T>
 struct ColorT {
@@ -29,6 +30,7 @@ struct ColorT {
 
 using RGBA = ColorT<uint8_t>;
 using RGBAF = ColorT<float>;
+using RGBA16 = ColorT<uint16_t>;
 
 constexpr RGBA uint32_to_rgba(uint32_t value) {
   return RGBA{
@@ -51,11 +53,26 @@ inline uint8_t unorm_to_uint8(float v) {
   return static_cast<uint8_t>(255.0 * std::clamp(v, 0.0f, 1.0f) + 0.5f);
 }
 
+inline float uint16_to_unorm(uint16_t v) {
+  return static_cast<float>(v) / 65535.0f;
+}
+
+inline uint16_t unorm_to_uint16(float v) {
+  return static_cast<uint16_t>(65535.0f * std::clamp(v, 0.0f, 1.0f) + 0.5f);
+}
+
 inline float srgb_to_linear(uint8_t c) {
-  const auto x = uint8_to_unorm(c);
-  return (x < 0.04045f ? 
-    x / 12.92f :
-    std::pow((x + 0.055f) / 1.055f, 2.4f));
+  static const auto table = []() {
+    auto table = std::array<float, 256>{ };
+    for (auto i = 0u; i < table.size(); ++i) {
+      const auto x = static_cast<float>(i) / 255.0f;
+      table[i] = (x < 0.04045f ?
+        x / 12.92f :
+        std::pow((x + 0.055f) / 1.055f, 2.4f));
+    }
+    return table;
+  }();
+  return table[c];
 }
 
 inline uint8_t linear_to_srgb(float x) {
@@ -82,3 +99,42 @@ inline RGBA linear_to_srgb(const RGBAF& c) {
     unorm_to_uint8(c.a)
   };
 }
+
+// linear 16 bit, precise enough to restore every 8 bit sRGB value
+inline uint16_t srgb_to_linear16(uint8_t c) {
+  static const auto table = []() {
+    auto table = std::array<uint16_t, 256>{ };
+    for (auto i = 0u; i < table.size(); ++i)
+      table[i] = unorm_to_uint16(srgb_to_linear(static_cast<uint8_t>(i)));
+    return table;
+  }();
+  return table[c];
+}
+
+inline uint8_t linear16_to_srgb(uint16_t c) {
+  static const auto table = []() {
+    auto table = std::array<uint8_t, 65536>{ };
+    for (auto i = 0u; i < table.size(); ++i)
+      table[i] = linear_to_srgb(uint16_to_unorm(static_cast<uint16_t>(i)));
+    return table;
+  }();
+  return table[c];
+}
+
+inline RGBA16 srgb_to_linear16(RGBA c) {
+  return {
+    srgb_to_linear16(c.r),
+    srgb_to_linear16(c.g),
+    srgb_to_linear16(c.b),
+    static_cast<uint16_t>(c.a * 257)
+  };
+}
+
+inline RGBA linear16_to_srgb(const RGBA16& c) {
+  return {
+    linear16_to_srgb(c.r),
+    linear16_to_srgb(c.g),
+    linear16_to_srgb(c.b),
+    static_cast<uint8_t>((c.a * 255 + 32767) / 65535)
+  };
+}
@@ -69,7 +69,10 @@ std::string_view get_definition_name(Definition definition) {
     case Definition::duplicates: return "duplicates";
     case Definition::alpha: return "alpha";
     case Definition::pack: return "pack";
+    case Definition::pack_time_limit: return "pack-time-limit";
+    case Definition::incremental: return "incremental";
     case Definition::debug: return "debug";
+    case Definition::compression: return "compression";
     case Definition::path: return "path";
     case Definition::glob: return "glob";
     case Definition::input: return "input";
@@ -150,10 +153,13 @@ Definition get_affected_definition(Definition definition) {
     case Definition::padding:
     case Definition::duplicates:
     case Definition::pack:
+    case Definition::pack_time_limit:
+    case Definition::incremental:
       return Definition::sheet;
 
     case Definition::alpha:
     case Definition::debug:
+    case Definition::compression:
       return Definition::output;
 
     case Definition::path:
@@ -470,17 +476,47 @@ void apply_definition(Definition definition,
       const auto string = check_string();
       if (const auto index = index_of(string, 
           { "binpack", "rows", "columns", "compact", 
-            "origin", "single", "layers", "keep" }); index >= 0)
+            "origin", "single", "layers", "keep", "shelf", "hierarchical", "polygon", "grid" }); index >= 0)
         state.pack = static_cast<Pack>(index);
       else
         error("invalid pack method '", string, "'");
+
+      if (state.pack == Pack::shelf && arguments_left()) {
+        const auto orientation = check_string();
+        if (orientation == "columns")
+          state.pack = Pack::shelf_columns;
+        else if (orientation != "rows")
+          error("invalid shelf orientation '", orientation, "'");
+      }
       break;
     }
 
+    case Definition::pack_time_limit:
+      state.pack_time_limit = check_real();
+      check(state.pack_time_limit >= 0, "invalid time limit");
+      break;
+
+    case Definition::incremental:
+      state.incremental = true;
+      state.min_occupancy = (arguments_left() ? check_real() : 0.5);
+      check(state.min_occupancy >= 0 && state.min_occupancy <= 1,
+        "invalid occupancy");
+      break;
+
     case Definition::debug:
       state.debug = check_bool(true);
       break;
 
+    case Definition::compression: {
+      const auto string = check_string();
+      if (const auto index = index_of(string, 
+          { "default", "fast", "max" }); index >= 0)
+        state.compression = static_cast<Compression>(index);
+      else
+        error("invalid compression value '", string, "'");
+      break;
+    }
+
     case Definition::path:
       state.path = check_path();
       break;
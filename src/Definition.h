@@ -24,7 +24,10 @@ enum class Definition {
   duplicates,
   alpha,
   pack,
+  pack_time_limit,
+  incremental,
   debug,
+  compression,
 
   path,
   glob,
@@ -96,7 +99,12 @@ struct State {
   Alpha alpha{ };
   RGBA alpha_color{ };
   Pack pack{ };
+  // wall-clock seconds binpack may spend trying further heuristics
+  real pack_time_limit{ };
+  bool incremental{ };
+  real min_occupancy{ };
   bool debug{ };
+  Compression compression{ };
 
   std::filesystem::path path;
   std::string glob_pattern;
@@ -392,10 +392,8 @@ void InputParser::deduce_grid_sprites(State& state) {
     for (; x < cells_x; x += span_x) {      
       const auto rect = intersect(deduce_rect_from_grid(state), source->rect());
 
-      if (empty(rect) ||
-          (state.trim_gray_levels ?
-           is_fully_black(source->image(), state.trim_threshold, rect) :
-           is_fully_transparent(source->image(), state.trim_threshold, rect))) {
+      if (empty(rect) || source->occupancy(state.trim_gray_levels,
+            state.trim_threshold).is_empty(rect)) {
         ++skipped;
         continue;
       }
@@ -433,8 +431,10 @@ void InputParser::deduce_grid_sprites(State& state) {
 void InputParser::deduce_atlas_sprites(State& state) {
   const auto source = get_source(state);
   const auto is_update = (sprites_or_skips_in_current_input() != 0);
+  const auto pin = source->pin();
   for (const auto& rect : find_islands(source->image(),
-      state.atlas_merge_distance, state.trim_gray_levels)) {
+      source->occupancy(state.trim_gray_levels, 1),
+      state.atlas_merge_distance)) {
     if (is_update && overlaps_sprite_or_skipped_rect(rect))
       continue;
 
@@ -487,6 +487,9 @@ void InputParser::sheet_ends(State& state) {
   sheet.shape_padding = state.shape_padding;
   sheet.duplicates = state.duplicates;
   sheet.pack = state.pack;
+  sheet.pack_time_limit = state.pack_time_limit;
+  sheet.incremental = state.incremental;
+  sheet.min_occupancy = state.min_occupancy;
 }
 
 void InputParser::output_ends(State& state) {
@@ -501,6 +504,7 @@ void InputParser::output_ends(State& state) {
   output->alpha_color = state.alpha_color;
   output->transforms = state.transforms;
   output->debug = state.debug;
+  output->compression = state.compression;
   output->scale = get_transform_scale(state.transforms);
 }
 
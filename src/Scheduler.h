@@ -36,6 +36,11 @@ public:
       thread.join();
   }
 
+  // including the thread calling for_each_parallel
+  size_t thread_count() const {
+    return m_threads.size() + 1;
+  }
+
   void async(AsyncFunction&& function) noexcept {
     auto lock = std::unique_lock(m_tasks_mutex);
     m_tasks.push_back({ std::move(function), 1, 1 });
@@ -6,21 +6,69 @@
 #include <stdexcept>
 #include <cstring>
 #include <utility>
+#include <numeric>
+#include <atomic>
 
 #define TEXBLEED_IMPLEMENTATION
 #include "rmj/rmj_texbleed.h"
 
+#if defined(__x86_64__) || defined(_M_X64)
+# define SPRIGHT_SSE2
+# include <emmintrin.h>
+#endif
+
 namespace spright {
 
 namespace {
-  const RGBA& checked_rgba_at(ImageView<const RGBA> image_rgba, const Point& p) {
-    check(containing(image_rgba.rect(), p));
-    return image_rgba.value_at(p);
+  // smaller images are not worth splitting
+  const auto parallel_resize_pixels = int64_t{ 1024 * 1024 };
+
+  // size classes are quarter steps between powers of two
+  const auto min_pooled_size = size_t{ 4096 };
+  const auto max_pooled_size = size_t{ 64 * 1024 * 1024 };
+  const auto size_class_count = size_t{ 14 * 4 + 1 };
+  const auto max_pooled_buffers = size_t{ 8 };
+
+  // idle buffers of all threads' pools
+  std::atomic<size_t> g_pooled_bytes;
+  std::atomic<size_t> g_max_pooled_bytes{ default_buffer_pool_limit };
+
+  size_t get_class_size(size_t size_class) {
+    const auto base = min_pooled_size << (size_class / 4);
+    return base + base / 4 * (size_class % 4);
   }
 
-  RGBA& checked_rgba_at(ImageView<RGBA> image_rgba, const Point& p) {
-    check(containing(image_rgba.rect(), p));
-    return image_rgba.value_at(p);
+  size_t get_size_class(size_t size_bytes) {
+    auto size_class = size_t{ };
+    while (get_class_size(size_class) < size_bytes)
+      ++size_class;
+    return size_class;
+  }
+
+  // released buffers are kept by the releasing thread
+  thread_local bool t_buffer_pool_destroyed;
+
+  struct BufferPool {
+    std::array<std::vector<std::byte*>, size_class_count> buffers;
+
+    BufferPool() {
+      for (auto& buffer : buffers)
+        buffer.reserve(max_pooled_buffers);
+    }
+
+    ~BufferPool() {
+      for (auto size_class = size_t{ }; size_class < size_class_count; ++size_class)
+        for (auto data : buffers[size_class]) {
+          g_pooled_bytes -= get_class_size(size_class);
+          delete[] data;
+        }
+      t_buffer_pool_destroyed = true;
+    }
+  };
+
+  BufferPool& get_buffer_pool() {
+    thread_local auto s_buffer_pool = BufferPool();
+    return s_buffer_pool;
   }
 
   template <typename ImageView, typename P>
@@ -50,105 +98,154 @@ namespace {
     }
   }
 
-  template <int sides, // 4 or 8
-    typename Color,
-    typename GetPixel, // Color&(int x, int y)
-    typename Match, // bool Match(Color color)
-    typename Count> // void Count(int x, int y)
-  void flood_fill(
-      int start_x, int start_y,
-      int w, int h,
-      const Color& new_color,
-      GetPixel&& get_pixel,
-      Match&& match,
-      Count&& count = [](int, int) {}) {
-
-    // cancel when new color is indistinguishable from rest
-    if (match(new_color))
-      return;
+  // horizontal run of set pixels [x0, x1)
+  struct Run {
+    int x0;
+    int x1;
+    int y;
+  };
 
-    auto stack = std::vector<Point>();
-    const auto add = [&](auto x, auto y) {
-      auto& pixel = get_pixel(x, y);
-      if (match(pixel)) {
-        pixel = new_color;
-        stack.push_back(Point{ x, y });
-      }
-    };
-    add(start_x, start_y);
-
-    while (!stack.empty()) {
-      const auto [x, y] = stack.back();
-      stack.pop_back();
-      count(x, y);
-
-      if (y > 0) add(x, y - 1);
-      if (y < h - 1) add(x, y + 1);
-      if (sides == 4) {
-        if (x > 0) add(x - 1, y);
-        if (x < w - 1) add(x + 1, y);
-      }
-      else {
-        if (x > 0) {
-          add(x - 1, y);
-          if (y > 0) add(x - 1, y - 1);
-          if (y < h - 1) add(x - 1, y + 1);
-        }
-        if (x < w - 1) {
-          add(x + 1, y);
-          if (y > 0) add(x + 1, y - 1);
-          if (y < h - 1) add(x + 1, y + 1);
+  int find_root(std::vector<int>& parent, int index) {
+    while (parent[to_unsigned(index)] != index) {
+      auto& p = parent[to_unsigned(index)];
+      p = parent[to_unsigned(p)];
+      index = p;
+    }
+    return index;
+  }
+
+  // the root is always the first run of a component
+  bool unite(std::vector<int>& parent, int a, int b) {
+    a = find_root(parent, a);
+    b = find_root(parent, b);
+    if (a == b)
+      return false;
+    parent[to_unsigned(std::max(a, b))] = std::min(a, b);
+    return true;
+  }
+
+  // unites 8-way connected runs of two successive rows
+  void connect_rows(const std::vector<Run>& runs, std::vector<int>& parent,
+      size_t above_begin, size_t above_end, size_t begin, size_t end) {
+    auto i = above_begin;
+    auto j = begin;
+    while (i < above_end && j < end) {
+      const auto& a = runs[i];
+      const auto& b = runs[j];
+      if (a.x0 <= b.x1 && b.x0 <= a.x1)
+        unite(parent, to_int(i), to_int(j));
+      if (a.x1 < b.x1) ++i; else ++j;
+    }
+  }
+
+  struct Stripe {
+    std::vector<Run> runs;
+    std::vector<int> parent;
+    size_t first_row_end;
+    size_t last_row_begin;
+  };
+
+  // labels each stripe of rows independently
+  Stripe label_stripe(ImageView<const RGBA::Channel> levels, int y0, int y1) {
+    auto stripe = Stripe{ };
+    auto above_begin = size_t{ };
+    for (auto y = y0; y < y1; ++y) {
+      const auto begin = stripe.runs.size();
+      const auto row = levels.values_at(0, y);
+      for (auto x = 0; x < levels.width(); ) {
+        if (!row[x]) {
+          ++x;
+          continue;
         }
+        const auto x0 = x;
+        while (x < levels.width() && row[x])
+          ++x;
+        stripe.parent.push_back(to_int(stripe.runs.size()));
+        stripe.runs.push_back({ x0, x, y });
       }
+      if (y > y0)
+        connect_rows(stripe.runs, stripe.parent, above_begin, begin,
+          begin, stripe.runs.size());
+      if (y == y0)
+        stripe.first_row_end = stripe.runs.size();
+      stripe.last_row_begin = begin;
+      above_begin = begin;
     }
+    return stripe;
   }
 
-  void merge_adjacent_rects(const Image& image, std::vector<Rect>& rects,
-      int distance, bool gray_levels) {
+  // two-pass union-find labeling of 8-way connected components
+  std::vector<Rect> find_components(ImageView<const RGBA::Channel> levels) {
+    const auto stripe_height = 64;
+    const auto stripe_count = (levels.height() + stripe_height - 1) / stripe_height;
+    auto stripes = std::vector<Stripe>(to_unsigned(stripe_count));
+    scheduler.for_each_parallel(stripes.size(), [&](size_t i) {
+      const auto y0 = to_int(i) * stripe_height;
+      stripes[i] = label_stripe(levels, y0,
+        std::min(y0 + stripe_height, levels.height()));
+    });
 
-    const auto adjacent = [&](const Rect& a, const Rect& b) {
-      if (containing(a, b) || containing(b, a))
-        return true;
-      const auto intersection = intersect(a, expand(b, distance));
-      if (empty(intersection))
-        return false;
-      if (gray_levels)
-        return !is_fully_black(image, 1, intersection);
-      return !is_fully_transparent(image, 1, intersection);
-    };
+    // concatenate stripes and merge at seams
+    auto runs = std::vector<Run>();
+    auto parent = std::vector<int>();
+    auto previous_last_row = std::pair<size_t, size_t>{ };
+    for (auto& stripe : stripes) {
+      const auto offset = runs.size();
+      runs.insert(runs.end(), stripe.runs.begin(), stripe.runs.end());
+      for (auto p : stripe.parent)
+        parent.push_back(p + to_int(offset));
+      connect_rows(runs, parent, previous_last_row.first,
+        previous_last_row.second, offset, offset + stripe.first_row_end);
+      previous_last_row = { offset + stripe.last_row_begin, runs.size() };
+    }
 
-    for (;;) {
-      auto merged = false;
-      for (auto i = size_t{ }; i < rects.size(); ++i) {
-        auto& a = rects[i];
-        for (auto j = i + 1; j < rects.size(); ) {
-          auto& b = rects[j];
-          if (adjacent(a, b)) {
-            a = combine(a, b);
-            b = rects.back();
-            rects.pop_back();
-            merged = true;
-          }
-          else {
-            ++j;
-          }
-        }
+    // bounding rect of each component, in order of first pixel
+    auto components = std::vector<Rect>();
+    auto component_index = std::vector<int>(runs.size(), -1);
+    for (auto i = size_t{ }; i < runs.size(); ++i) {
+      const auto& run = runs[i];
+      const auto rect = Rect{ run.x0, run.y, run.x1 - run.x0, 1 };
+      auto& index = component_index[to_unsigned(find_root(parent, to_int(i)))];
+      if (index < 0) {
+        index = to_int(components.size());
+        components.push_back(rect);
+      }
+      else {
+        auto& component = components[to_unsigned(index)];
+        component = combine(component, rect);
       }
-      if (!merged)
-        break;
     }
+    return components;
   }
 
-  // http://paulbourke.net/geometry/polygonmesh/
-  bool point_in_polygon(real x, real y, const std::vector<PointF>& p) {
-    auto c = false;
-    for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++) {
-      if ((((p[i].y <= y) && (y < p[j].y)) ||
-           ((p[j].y <= y) && (y < p[i].y))) &&
-          (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
-        c = !c;
+  // calls F(y, x0, x1) for each span [x0, x1) of pixels, whose center is
+  // inside the polygon (even-odd rule, like point in polygon test from
+  // http://paulbourke.net/geometry/polygonmesh/)
+  template<typename F>
+  void for_each_polygon_span(const std::vector<PointF>& p, int w, int h, F&& func) {
+    if (p.empty())
+      return;
+    auto crossings = std::vector<real>();
+    for (auto y = 0; y < h; ++y) {
+      const auto cy = y + real{ 0.5 };
+      crossings.clear();
+      for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++)
+        if (((p[i].y <= cy) && (cy < p[j].y)) ||
+            ((p[j].y <= cy) && (cy < p[i].y)))
+          crossings.push_back(
+            (p[j].x - p[i].x) * (cy - p[i].y) / (p[j].y - p[i].y) + p[i].x);
+      std::sort(crossings.begin(), crossings.end());
+
+      // pixel center x + 0.5 is inside within [c0, c1)
+      for (auto i = size_t{ 1 }; i < crossings.size(); i += 2) {
+        const auto x0 = std::max(0, floor_to_int(std::ceil(
+          std::clamp(crossings[i - 1] - 0.5, real{ -1 }, to_real(w)))));
+        const auto x1 = std::min(w, floor_to_int(std::ceil(
+          std::clamp(crossings[i] - 0.5, real{ -1 }, to_real(w)))));
+        if (x0 < x1)
+          func(y, x0, x1);
+      }
     }
-    return c;
   }
 
   RGBAF blend(const RGBAF& a, const RGBAF& b, float mix) {
@@ -164,10 +261,32 @@ namespace {
     };
   }
 
-  RGBAF sample_bilinear(ImageView<const RGBAF> image, const PointF& point,
-      const RGBAF& background) {
+  RGBAF to_rgbaf(const RGBAF& color) { return color; }
+  RGBAF to_rgbaf(const RGBA16& color) {
+    return {
+      uint16_to_unorm(color.r),
+      uint16_to_unorm(color.g),
+      uint16_to_unorm(color.b),
+      uint16_to_unorm(color.a),
+    };
+  }
+
+  template<typename T> T from_rgbaf(const RGBAF& color);
+  template<> RGBAF from_rgbaf(const RGBAF& color) { return color; }
+  template<> RGBA16 from_rgbaf(const RGBAF& color) {
+    return {
+      unorm_to_uint16(color.r),
+      unorm_to_uint16(color.g),
+      unorm_to_uint16(color.b),
+      unorm_to_uint16(color.a),
+    };
+  }
+
+  template<typename T>
+  T sample_bilinear(ImageView<const T> image, const PointF& point,
+      const T& background) {
     const auto sample = [&](const Point& p) {
-      return (containing(image.rect(), p) ? image.value_at(p) : background);
+      return to_rgbaf(containing(image.rect(), p) ? image.value_at(p) : background);
     };
     const auto int_remainder = [](real value) {
       const auto i = std::floor(value);
@@ -179,12 +298,204 @@ namespace {
     const auto c1 = sample(Point(ix + 1, iy));
     const auto c2 = sample(Point(ix, iy + 1));
     const auto c3 = sample(Point(ix + 1, iy + 1));
-    return blend(blend(c0, c1, rx), blend(c2, c3, rx), ry);
+    return from_rgbaf<T>(blend(blend(c0, c1, rx), blend(c2, c3, rx), ry));
   }
 
-  template<typename T, typename Sample>
-  Image rotate_image_sample(ImageView<const T> source, 
-      real angle, const Sample&& sample) {
+  // point needs to be within [0, width - 1) x [0, height - 1)
+  template<typename T>
+  T sample_bilinear_unchecked(ImageView<const T> image, const PointF& point) {
+    const auto ix = static_cast<int>(point.x);
+    const auto iy = static_cast<int>(point.y);
+    const auto rx = static_cast<float>(point.x - ix);
+    const auto ry = static_cast<float>(point.y - iy);
+    const auto row0 = image.values_at(ix, iy);
+    const auto row1 = row0 + image.width();
+    return from_rgbaf<T>(blend(
+      blend(to_rgbaf(row0[0]), to_rgbaf(row0[1]), rx),
+      blend(to_rgbaf(row1[0]), to_rgbaf(row1[1]), rx), ry));
+  }
+
+  // x range [begin, end) of a row, for which u0 + x * du is within [min, max)
+  std::pair<int, int> clip_span(real u0, real du, real min, real max,
+      int begin, int end) {
+    // shrink by epsilon, the few pixels outside are sampled checked
+    const auto epsilon = real{ 0.0001 };
+    min += epsilon;
+    max -= epsilon;
+    if (min >= max)
+      return { begin, begin };
+    if (std::abs(du) < 1e-12)
+      return (u0 >= min && u0 < max ? std::pair(begin, end) : std::pair(begin, begin));
+    auto x0 = (min - u0) / du;
+    auto x1 = (max - u0) / du;
+    if (x0 > x1)
+      std::swap(x0, x1);
+    const auto clipped_begin = std::max(begin, floor_to_int(std::ceil(
+      std::max(x0, to_real(begin)))));
+    const auto clipped_end = std::min(end, floor_to_int(std::floor(
+      std::min(x1, to_real(end)))) + 1);
+    return { clipped_begin, std::max(clipped_begin, clipped_end) };
+  }
+
+  template<typename T>
+  void transpose_block_scalar(const T* source, ptrdiff_t source_stride,
+      T* dest, ptrdiff_t dest_stride, int w, int h) {
+    for (auto x = 0; x < w; ++x) {
+      auto dest_row = dest + x * dest_stride;
+      auto source_column = source + x;
+      for (auto y = 0; y < h; ++y, source_column += source_stride)
+        dest_row[y] = *source_column;
+    }
+  }
+
+  // transposes blocks of 4x4 4-byte or 2x2 8-byte pixels in registers
+  template<typename T>
+  void transpose_block(const T* source, ptrdiff_t source_stride,
+      T* dest, ptrdiff_t dest_stride, int w, int h) {
+#if defined(SPRIGHT_SSE2)
+    if constexpr (sizeof(T) == 4 || sizeof(T) == 8) {
+      constexpr auto n = static_cast<int>(16 / sizeof(T));
+      const auto load = [&](int x, int y) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+          source + y * source_stride + x));
+      };
+      const auto store = [&](int x, int y, __m128i value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(
+          dest + x * dest_stride + y), value);
+      };
+      const auto w_blocks = w - w % n;
+      const auto h_blocks = h - h % n;
+      for (auto y = 0; y < h_blocks; y += n)
+        for (auto x = 0; x < w_blocks; x += n) {
+          if constexpr (n == 4) {
+            const auto r0 = load(x, y + 0);
+            const auto r1 = load(x, y + 1);
+            const auto r2 = load(x, y + 2);
+            const auto r3 = load(x, y + 3);
+            const auto t0 = _mm_unpacklo_epi32(r0, r1);
+            const auto t1 = _mm_unpacklo_epi32(r2, r3);
+            const auto t2 = _mm_unpackhi_epi32(r0, r1);
+            const auto t3 = _mm_unpackhi_epi32(r2, r3);
+            store(x + 0, y, _mm_unpacklo_epi64(t0, t1));
+            store(x + 1, y, _mm_unpackhi_epi64(t0, t1));
+            store(x + 2, y, _mm_unpacklo_epi64(t2, t3));
+            store(x + 3, y, _mm_unpackhi_epi64(t2, t3));
+          }
+          else {
+            const auto r0 = load(x, y + 0);
+            const auto r1 = load(x, y + 1);
+            store(x + 0, y, _mm_unpacklo_epi64(r0, r1));
+            store(x + 1, y, _mm_unpackhi_epi64(r0, r1));
+          }
+        }
+      transpose_block_scalar(source + w_blocks, source_stride,
+        dest + w_blocks * dest_stride, dest_stride, w - w_blocks, h);
+      transpose_block_scalar(source + h_blocks * source_stride, source_stride,
+        dest + h_blocks, dest_stride, w_blocks, h - h_blocks);
+      return;
+    }
+#endif
+    transpose_block_scalar(source, source_stride, dest, dest_stride, w, h);
+  }
+
+  // sets dest[x * dest_stride + y] = source[y * source_stride + x],
+  // negative strides allow to flip while transposing
+  template<typename T>
+  void transpose(const T* source, ptrdiff_t source_stride,
+      T* dest, ptrdiff_t dest_stride, int w, int h) {
+    // tiled, so that source and dest rows stay in cache
+    const auto tile_size = 32;
+    for (auto y = 0; y < h; y += tile_size)
+      for (auto x = 0; x < w; x += tile_size)
+        transpose_block(
+          source + y * source_stride + x, source_stride,
+          dest + x * dest_stride + y, dest_stride,
+          std::min(tile_size, w - x), std::min(tile_size, h - y));
+  }
+
+  // exact multiples of 90 degrees only move pixels
+  template<typename T>
+  Image rotate_image_90(ImageView<const T> source, int quarters) {
+    const auto w = source.width();
+    const auto h = source.height();
+    auto dest = (quarters % 2 ?
+      Image(source.type(), h, w, source.storage()) :
+      Image(source.type(), w, h, source.storage()));
+    const auto dest_view = dest.view<T>();
+    const auto source_stride = ptrdiff_t{ w };
+    const auto dest_stride = ptrdiff_t{ dest.width() };
+
+    // each band of source columns becomes a band of dest rows
+    const auto band_size = 64;
+    const auto bands = (w + band_size - 1) / band_size;
+    scheduler.for_each_parallel(to_unsigned(bands), [&](size_t band) {
+      const auto x0 = to_int(band) * band_size;
+      const auto x1 = std::min(x0 + band_size, w);
+      switch (quarters) {
+        case 0:
+          for (auto y = 0; y < h; ++y)
+            std::copy(source.values_at(x0, y), source.values_at(x1, y),
+              dest_view.values_at(x0, y));
+          break;
+
+        case 1:
+          // clockwise, source is read bottom-up
+          return transpose(source.values_at(x0, h - 1), -source_stride,
+            dest_view.values_at(0, x0), dest_stride, x1 - x0, h);
+
+        case 2:
+          for (auto y = 0; y < h; ++y)
+            std::reverse_copy(source.values_at(x0, y), source.values_at(x1, y),
+              dest_view.values_at(w - x1, h - 1 - y));
+          break;
+
+        case 3:
+          // counter-clockwise, dest is written bottom-up
+          return transpose(source.values_at(x0, 0), source_stride,
+            dest_view.values_at(0, w - 1 - x0), -dest_stride, x1 - x0, h);
+      }
+    });
+    return dest;
+  }
+
+  // rotates clockwise, writing only pixels within spans
+  template<typename T>
+  void copy_rotated_cw_masked(ImageView<const T> source, const Rect& source_rect,
+      ImageView<T> dest, int dx, int dy,
+      const std::vector<std::vector<std::pair<int, int>>>& row_spans) {
+    const auto [sx, sy, w, h] = source_rect;
+    const auto tile_size = 32;
+    for (auto ty = 0; ty < h; ty += tile_size)
+      for (auto tx = 0; tx < w; tx += tile_size) {
+        const auto tw = std::min(tile_size, w - tx);
+        const auto th = std::min(tile_size, h - ty);
+        const auto covered = std::all_of(
+          row_spans.begin() + ty, row_spans.begin() + ty + th,
+          [&](const auto& spans) {
+            return std::any_of(spans.begin(), spans.end(), [&](const auto& span) {
+              return (span.first <= tx && span.second >= tx + tw);
+            });
+          });
+        if (covered) {
+          transpose_block(source.values_at(sx + tx, sy + ty + th - 1),
+            -ptrdiff_t{ source.width() },
+            dest.values_at(dx + h - ty - th, dy + tx), ptrdiff_t{ dest.width() },
+            tw, th);
+          continue;
+        }
+        for (auto y = ty; y < ty + th; ++y)
+          for (const auto& [x0, x1] : row_spans[to_unsigned(y)])
+            for (auto x = std::max(x0, tx); x < std::min(x1, tx + tw); ++x)
+              *dest.values_at(dx + h - 1 - y, dy + x) =
+                *source.values_at(sx + x, sy + y);
+      }
+  }
+
+  // Sample(point) is checked, SampleUnchecked(point) is only called for
+  // points within valid rect
+  template<typename T, typename Sample, typename SampleUnchecked>
+  Image rotate_image_sample(ImageView<const T> source, real angle,
+      const RectF& valid, Sample&& sample, SampleUnchecked&& sample_unchecked) {
     const auto cos = std::cos(angle);
     const auto sin = std::sin(angle);
     const auto transform = [&](real x, real y) -> PointF {
@@ -199,7 +510,8 @@ namespace {
     const auto p3 = transform( w2,  h2);
     const auto mx = std::max(std::max(std::max(p0.x, p1.x), p2.x), p3.x);
     const auto my = std::max(std::max(std::max(p0.y, p1.y), p2.y), p3.y);
-    auto dest = Image(source.type(), round_to_int(mx * 2.0), round_to_int(my * 2.0));
+    auto dest = Image(source.type(), round_to_int(mx * 2.0),
+      round_to_int(my * 2.0), source.storage());
     const auto dest_view = dest.view<T>();
 
     // not sure where these -0.5 come from...
@@ -209,27 +521,53 @@ namespace {
     const auto dest_center = PointF(
       to_real(dest.width()) / 2 - 0.5,
       to_real(dest.height()) / 2 - 0.5);
-    for (auto y = 0; y < dest.height(); ++y)
-      for (auto x = 0; x < dest.width(); ++x)
-        dest_view.value_at(Point(x, y)) = sample(
-          transform(x - dest_center.x, y - dest_center.y) + source_center);
 
+    // step source position along rows, only clipped spans are sampled unchecked
+    const auto step = PointF(cos, -sin);
+    scheduler.for_each_parallel(to_unsigned(dest.height()), [&](size_t row) {
+      const auto y = to_int(row);
+      const auto start = transform(-dest_center.x, y - dest_center.y) + source_center;
+      const auto [bx0, bx1] = clip_span(start.x, step.x,
+        valid.x, valid.x + valid.w, 0, dest.width());
+      const auto [begin, end] = clip_span(start.y, step.y,
+        valid.y, valid.y + valid.h, bx0, bx1);
+      const auto at = [&](int x) {
+        return PointF(start.x + step.x * x, start.y + step.y * x);
+      };
+      auto values = dest_view.values_at(0, y);
+      for (auto x = 0; x < begin; ++x)
+        *values++ = sample(at(x));
+      for (auto x = begin; x < end; ++x)
+        *values++ = sample_unchecked(at(x));
+      for (auto x = end; x < dest.width(); ++x)
+        *values++ = sample(at(x));
+    });
     return dest;
   }
 
-  Image rotate_image_bilinear(ImageView<const RGBAF> image_rgbaf, real angle, const RGBAF& background_rgbaf) {
-    return rotate_image_sample(image_rgbaf, angle, 
+  template<typename T>
+  Image rotate_image_bilinear(ImageView<const T> image, real angle, const T& background) {
+    const auto valid = RectF(0, 0, image.width() - 1, image.height() - 1);
+    return rotate_image_sample(image, angle, valid,
       [&](const PointF& pos) {
-        return sample_bilinear(image_rgbaf, pos, background_rgbaf);
+        return sample_bilinear(image, pos, background);
+      },
+      [&](const PointF& pos) {
+        return sample_bilinear_unchecked(image, pos);
       });
   }
 
-  Image rotate_image_nearest(ImageView<const RGBAF> image_rgbaf, real angle, const RGBAF& background_rgbaf) {
-    return rotate_image_sample(image_rgbaf, angle, 
+  template<typename T>
+  Image rotate_image_nearest(ImageView<const T> image, real angle, const T& background) {
+    const auto valid = RectF(-0.5, -0.5, image.width(), image.height());
+    return rotate_image_sample(image, angle, valid,
       [&](const PointF& pos) {
         const auto point = Point(round_to_int(pos.x), round_to_int(pos.y));
-        return (containing(image_rgbaf.rect(), point) ? 
-          image_rgbaf.value_at(point) : background_rgbaf);
+        return (containing(image.rect(), point) ?
+          image.value_at(point) : background);
+      },
+      [&](const PointF& pos) {
+        return *image.values_at(round_to_int(pos.x), round_to_int(pos.y));
       });
   }
 
@@ -237,7 +575,7 @@ namespace {
   Image downsample_image_sample(ImageView<const T> source, const SizeF& scale, const Sample&& sample) {
     auto dest = Image(source.type(),
       std::max(round_to_int(source.width() * scale.x), 1),
-      std::max(round_to_int(source.height() * scale.y), 1));
+      std::max(round_to_int(source.height() * scale.y), 1), source.storage());
     const auto dest_view = dest.view<T>();
 
     const auto factor = SizeF{
@@ -259,34 +597,212 @@ namespace {
       });
   }
 
-  Image downsample_image_median(ImageView<const RGBAF> image_rgbaf, const SizeF& scale) {
-    auto buckets = std::vector<std::pair<RGBAF, size_t>>{ };
-    const auto add = [&](const RGBAF& color) {
-      const auto it = std::find_if(buckets.begin(), buckets.end(), 
-        [&](const auto& bucket) { return (bucket.first == color); });
-      if (it != buckets.end())
-        ++it->second;
-      else
-        buckets.emplace_back(color, 1);
+  template<typename T>
+  uint64_t hash_color(const T& color) {
+    uint64_t words[(sizeof(T) + 7) / 8] = { };
+    std::memcpy(words, &color, sizeof(T));
+    auto hash = uint64_t{ };
+    for (auto word : words)
+      hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 32);
+  }
+
+  // counts colors of a block, which can be reused without clearing
+  template<typename T>
+  class ColorHistogram {
+  public:
+    explicit ColorHistogram(size_t max_colors) {
+      auto capacity = size_t{ 16 };
+      while (capacity < max_colors * 2)
+        capacity *= 2;
+      m_slots.resize(capacity);
+      m_used.reserve(max_colors);
+    }
+
+    // most frequent color, ties resolve to the one added first
+    const T& find_mode(const T* colors, size_t count) {
+      if (++m_generation == 0) {
+        for (auto& slot : m_slots)
+          slot.generation = 0;
+        m_generation = 1;
+      }
+      m_used.clear();
+      const auto mask = m_slots.size() - 1;
+      for (auto i = size_t{ }; i < count; ++i) {
+        auto index = static_cast<size_t>(hash_color(colors[i])) & mask;
+        for (;;) {
+          auto& slot = m_slots[index];
+          if (slot.generation != m_generation) {
+            slot = { colors[i], m_generation, 1 };
+            m_used.push_back(index);
+            break;
+          }
+          if (slot.color == colors[i]) {
+            ++slot.count;
+            break;
+          }
+          index = (index + 1) & mask;
+        }
+      }
+      auto best = &m_slots[m_used.front()];
+      for (auto index : m_used)
+        if (m_slots[index].count > best->count)
+          best = &m_slots[index];
+      return best->color;
+    }
+
+  private:
+    struct Slot {
+      T color;
+      uint32_t generation;
+      uint32_t count;
     };
-    return downsample_image_sample(image_rgbaf, scale,
-      [&](const RectF& rect) {
-        buckets.clear();
-        for (auto y = rect.y; y < rect.y + rect.h; y += 1.0)
-          for (auto x = rect.x; x < rect.x + rect.w; x += 1.0)
-            add(image_rgbaf.value_at(Point(round_to_int(x), round_to_int(y))));
-        const auto it = std::max_element(buckets.begin(), buckets.end(), 
-          [](const auto& a, const auto& b) { return a.second < b.second; });
-        return it->first;
-      });
+    std::vector<Slot> m_slots;
+    std::vector<size_t> m_used;
+    uint32_t m_generation{ };
+  };
+
+  // quadratic, but faster than hashing for few colors
+  template<typename T, size_t N>
+  const T& find_mode(const std::array<T, N>& colors) {
+    auto best = size_t{ };
+    auto best_count = size_t{ };
+    for (auto i = size_t{ }; i < N; ++i) {
+      auto count = size_t{ 1 };
+      for (auto j = i + 1; j < N; ++j)
+        if (colors[j] == colors[i])
+          ++count;
+      if (count > best_count) {
+        best = i;
+        best_count = count;
+      }
+    }
+    return colors[best];
+  }
+
+  template<typename T, int Factor>
+  void downsample_median_integer(ImageView<const T> image, ImageView<T> dest) {
+    scheduler.for_each_parallel(to_unsigned(dest.height()), [&](size_t row) {
+      const auto y = to_int(row);
+      auto histogram = ColorHistogram<T>(Factor * Factor);
+      auto colors = std::array<T, size_t{ Factor * Factor }>();
+      auto output = dest.values_at(0, y);
+      for (auto x = 0; x < dest.width(); ++x) {
+        for (auto i = 0; i < Factor; ++i)
+          std::copy_n(image.values_at(x * Factor, y * Factor + i), Factor,
+            colors.begin() + i * Factor);
+        if constexpr (Factor <= 3)
+          *output++ = find_mode(colors);
+        else
+          *output++ = histogram.find_mode(colors.data(), colors.size());
+      }
+    });
+  }
+
+  // source coordinates sampled by each destination row or column
+  std::vector<std::vector<int>> get_median_samples(int source_size, int dest_size) {
+    const auto factor = to_real(source_size) / dest_size;
+    auto samples = std::vector<std::vector<int>>(to_unsigned(dest_size));
+    for (auto i = 0; i < dest_size; ++i) {
+      const auto begin = i * factor;
+      for (auto v = begin; v < begin + factor; v += 1.0)
+        samples[to_unsigned(i)].push_back(
+          std::min(round_to_int(v), source_size - 1));
+    }
+    return samples;
+  }
+
+  // takes most frequent color of each block, so no new colors are introduced
+  template<typename T>
+  Image downsample_image_median(ImageView<const T> image, const SizeF& scale) {
+    auto dest = Image(image.type(),
+      std::max(round_to_int(image.width() * scale.x), 1),
+      std::max(round_to_int(image.height() * scale.y), 1), image.storage());
+    const auto dest_view = dest.view<T>();
+
+    const auto factor_x = image.width() / dest.width();
+    const auto factor_y = image.height() / dest.height();
+    if (factor_x == factor_y &&
+        image.width() == dest.width() * factor_x &&
+        image.height() == dest.height() * factor_y &&
+        factor_x >= 2 && factor_x <= 4) {
+      switch (factor_x) {
+        case 2: downsample_median_integer<T, 2>(image, dest_view); break;
+        case 3: downsample_median_integer<T, 3>(image, dest_view); break;
+        case 4: downsample_median_integer<T, 4>(image, dest_view); break;
+      }
+      return dest;
+    }
+
+    const auto columns = get_median_samples(image.width(), dest.width());
+    const auto rows = get_median_samples(image.height(), dest.height());
+    const auto max_count = std::max_element(columns.begin(), columns.end(),
+      [](const auto& a, const auto& b) { return a.size() < b.size(); })->size() *
+      std::max_element(rows.begin(), rows.end(),
+      [](const auto& a, const auto& b) { return a.size() < b.size(); })->size();
+
+    scheduler.for_each_parallel(rows.size(), [&](size_t row) {
+      auto histogram = ColorHistogram<T>(max_count);
+      auto colors = std::vector<T>();
+      colors.reserve(max_count);
+      auto output = dest_view.values_at(0, to_int(row));
+      for (const auto& column : columns) {
+        colors.clear();
+        for (auto y : rows[row]) {
+          const auto source_row = image.values_at(0, y);
+          for (auto x : column)
+            colors.push_back(source_row[x]);
+        }
+        *output++ = histogram.find_mode(colors.data(), colors.size());
+      }
+    });
+    return dest;
   }
 } // namespace
 
+std::byte* allocate_pooled(size_t size_bytes, size_t* size_class) {
+  if (size_bytes > max_pooled_size || t_buffer_pool_destroyed)
+    return nullptr;
+  *size_class = get_size_class(size_bytes);
+  auto& pool = get_buffer_pool();
+  auto& buffers = pool.buffers[*size_class];
+  if (buffers.empty())
+    return new std::byte[get_class_size(*size_class)];
+  const auto data = buffers.back();
+  buffers.pop_back();
+  g_pooled_bytes -= get_class_size(*size_class);
+  return data;
+}
+
+void release_pooled(std::byte* data, size_t size_class) {
+  const auto size = get_class_size(size_class);
+  if (!t_buffer_pool_destroyed) {
+    auto& buffers = get_buffer_pool().buffers[size_class];
+    if (buffers.size() < max_pooled_buffers) {
+      if (g_pooled_bytes.fetch_add(size) + size <= g_max_pooled_bytes) {
+        buffers.push_back(data);
+        return;
+      }
+      g_pooled_bytes -= size;
+    }
+  }
+  delete[] data;
+}
+
+void set_buffer_pool_limit(size_t bytes) {
+  g_max_pooled_bytes = bytes;
+}
+
+size_t get_pooled_bytes() {
+  return g_pooled_bytes;
+}
+
 Image clone_image(const Image& image, const Rect& rect, int padding) {
   if (empty(rect))
     return clone_image(image, image.rect(), padding);
   check_rect(image, rect);
-  auto clone = Image(image.type(), rect.w + padding * 2, rect.h + padding * 2);
+  auto clone = Image(image.type(), rect.w + padding * 2, rect.h + padding * 2,
+    image.storage());
   if (padding)
     std::memset(clone.data().data(), 0x00, clone.data().size_bytes());
   copy_rect(image, rect, clone, padding, padding);
@@ -323,12 +839,8 @@ void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, Image& d
   const auto [sx, sy, w, h] = source_rect;
   check_rect(source, source_rect);
   check_rect(dest, { dx, dy, h, w });
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      std::memcpy(
-        dest_rgba.values_at(dx + h-1 - y, dy + x),
-        source_rgba.values_at(sx + x, sy + y),
-        sizeof(RGBA));
+  transpose(source_rgba.values_at(sx, sy + h - 1), -ptrdiff_t{ source.width() },
+    dest_rgba.values_at(dx, dy), ptrdiff_t{ dest.width() }, w, h);
 }
 
 void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx, int dy,
@@ -336,23 +848,28 @@ void copy_rect(const Image& source, const Rect& source_rect, Image& dest, int dx
   const auto source_rgba = source.view<RGBA>();
   const auto dest_rgba = dest.view<RGBA>();
   const auto [sx, sy, w, h] = source_rect;
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      if (point_in_polygon(x + 0.5, y + 0.5, mask_outline))
-        checked_rgba_at(dest_rgba, { dx + x, dy + y }) = 
-          checked_rgba_at(source_rgba, { sx + x, sy + y });
+  for_each_polygon_span(mask_outline, w, h, [&](int y, int x0, int x1) {
+    check_rect(source_rgba, { sx + x0, sy + y, x1 - x0, 1 });
+    check_rect(dest_rgba, { dx + x0, dy + y, x1 - x0, 1 });
+    std::memcpy(
+      dest_rgba.values_at(dx + x0, dy + y),
+      source_rgba.values_at(sx + x0, sy + y),
+      to_unsigned(x1 - x0) * sizeof(RGBA));
+  });
 }
 
 void copy_rect_rotated_cw(const Image& source, const Rect& source_rect, 
     Image& dest, int dx, int dy, const std::vector<PointF>& mask_outline) {
-  const auto source_rgba = source.view<RGBA>();
-  const auto dest_rgba = dest.view<RGBA>();
   const auto [sx, sy, w, h] = source_rect;
-  for (auto y = 0; y < h; ++y)
-    for (auto x = 0; x < w; ++x)
-      if (point_in_polygon(x + 0.5, y + 0.5, mask_outline))
-        checked_rgba_at(dest_rgba, { dx + (h-1 - y), dy + x }) =
-          checked_rgba_at(source_rgba, { sx + x, sy + y });
+  auto row_spans = std::vector<std::vector<std::pair<int, int>>>(to_unsigned(h));
+  for_each_polygon_span(mask_outline, w, h, [&](int y, int x0, int x1) {
+    // span becomes a column
+    check_rect(source, { sx + x0, sy + y, x1 - x0, 1 });
+    check_rect(dest, { dx + (h-1 - y), dy + x0, 1, x1 - x0 });
+    row_spans[to_unsigned(y)].emplace_back(x0, x1);
+  });
+  copy_rotated_cw_masked(source.view<RGBA>(), source_rect,
+    dest.view<RGBA>(), dx, dy, row_spans);
 }
 
 void extrude_rect(Image& image, const Rect& rect, int count, WrapMode mode,
@@ -444,36 +961,36 @@ bool is_identical(const Image& image_a, const Rect& rect_a, const Image& image_b
   return true;
 }
 
-Rect get_used_rect(const Image& image, bool gray_levels, int threshold, const Rect& rect) {
-  if (empty(rect))
-    return get_used_rect(image, gray_levels, threshold, image.rect());
-
-  const auto x1 = rect.x + rect.w - 1;
-  const auto y1 = rect.y + rect.h - 1;
-
-  const auto check = (gray_levels ? is_fully_black : is_fully_transparent);
-
-  auto min_y = rect.y;
-  for (; min_y < y1; ++min_y)
-    if (!check(image, threshold, { rect.x, min_y, rect.w, 1 }))
-      break;
-
-  auto max_y = y1;
-  for (; max_y > min_y; --max_y)
-    if (!check(image, threshold, { rect.x, max_y, rect.w, 1 }))
-      break;
-
-  auto min_x = rect.x;
-  for (; min_x < x1; ++min_x)
-    if (!check(image, threshold, { min_x, min_y, 1, max_y - min_y + 1 }))
-      break;
+uint64_t get_hash(const Image& image, const Rect& rect) {
+  check_rect(image, rect);
 
-  auto max_x = x1;
-  for (; max_x > min_x; --max_x)
-    if (!check(image, threshold, { max_x, min_y, 1, max_y - min_y + 1 }))
-      break;
+  // FNV-1a like, but consuming 8 bytes at a time
+  const auto prime = uint64_t{ 0x100000001B3 };
+  auto hash = uint64_t{ 0xCBF29CE484222325 };
+  const auto add = [&](uint64_t value) {
+    hash = (hash ^ value) * prime;
+  };
+  add(to_unsigned(rect.w));
+  add(to_unsigned(rect.h));
 
-  return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+  const auto image_rgba = image.view<RGBA>();
+  const auto row_size = to_unsigned(rect.w) * sizeof(RGBA);
+  for (auto y = 0; y < rect.h; ++y) {
+    const auto row = reinterpret_cast<const std::byte*>(
+      image_rgba.values_at(rect.x, rect.y + y));
+    auto i = size_t{ };
+    for (; i + sizeof(uint64_t) <= row_size; i += sizeof(uint64_t)) {
+      auto value = uint64_t{ };
+      std::memcpy(&value, row + i, sizeof(uint64_t));
+      add(value);
+    }
+    if (i < row_size) {
+      auto value = uint64_t{ };
+      std::memcpy(&value, row + i, row_size - i);
+      add(value);
+    }
+  }
+  return hash;
 }
 
 RGBA guess_colorkey(const Image& image) {
@@ -499,41 +1016,124 @@ void replace_color(Image& image, RGBA original, RGBA color) {
       image_rgba.values() + image_rgba.size(), original, color);
 }
 
+// merges rects, when the first is within distance of the second one's pixels.
+// Results in the same rects as testing all pairs in order, until nothing
+// is merged, but only the rects of neighboring grid cells are tested.
+void merge_adjacent_rects(const OccupancyMap& occupancy,
+    std::vector<Rect>& rects, int distance) {
+  if (rects.size() < 2)
+    return;
+
+  const auto adjacent = [&](const Rect& a, const Rect& b) {
+    if (containing(a, b) || containing(b, a))
+      return true;
+    const auto intersection = intersect(a, expand(b, distance));
+    return (!empty(intersection) && !occupancy.is_empty(intersection));
+  };
+
+  // cells are at least as big as the biggest rect plus distance,
+  // but there are not many more cells than rects
+  auto bounds = rects.front();
+  auto extent = 1;
+  for (const auto& rect : rects) {
+    bounds = combine(bounds, rect);
+    extent = std::max({ extent, rect.w, rect.h });
+  }
+  const auto area = int64_t{ bounds.w } * bounds.h;
+  const auto min_cell_size = static_cast<int>(std::ceil(
+    std::sqrt(static_cast<double>(area) / static_cast<double>(rects.size()))));
+  const auto cell_size = std::max(extent + distance, min_cell_size);
+  const auto columns = (bounds.w - 1) / cell_size + 1;
+  const auto rows = (bounds.h - 1) / cell_size + 1;
+  auto cells = std::vector<std::vector<int>>(to_unsigned(columns * rows));
+  const auto for_each_cell = [&](const Rect& rect, auto&& function) {
+    const auto x0 = std::clamp((rect.x - bounds.x) / cell_size, 0, columns - 1);
+    const auto y0 = std::clamp((rect.y - bounds.y) / cell_size, 0, rows - 1);
+    const auto x1 = std::clamp((rect.x1() - 1 - bounds.x) / cell_size, 0, columns - 1);
+    const auto y1 = std::clamp((rect.y1() - 1 - bounds.y) / cell_size, 0, rows - 1);
+    for (auto y = y0; y <= y1; ++y)
+      for (auto x = x0; x <= x1; ++x)
+        function(cells[to_unsigned(y * columns + x)]);
+  };
+
+  // rects keep their id, while their position in the list changes
+  auto ids = std::vector<int>(rects.size());
+  auto positions = std::vector<size_t>(rects.size());
+  for (auto i = size_t{ }; i < rects.size(); ++i) {
+    ids[i] = to_int(i);
+    positions[i] = i;
+    for_each_cell(rects[i], [&](std::vector<int>& cell) {
+      cell.push_back(to_int(i));
+    });
+  }
+  auto candidates = std::vector<size_t>();
+
+  for (;;) {
+    auto merged = false;
+    for (auto i = size_t{ }; i < rects.size(); ++i) {
+      auto& a = rects[i];
+      for (auto j = i + 1; j < rects.size(); ) {
+        // rects before j were already tested against a
+        candidates.clear();
+        for_each_cell(expand(a, distance), [&](const std::vector<int>& cell) {
+          for (const auto id : cell) {
+            const auto position = positions[to_unsigned(id)];
+            if (position >= j && position < rects.size() &&
+                ids[position] == id)
+              candidates.push_back(position);
+          }
+        });
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+          candidates.end());
+        const auto it = std::find_if(candidates.begin(), candidates.end(),
+          [&](size_t position) { return adjacent(a, rects[position]); });
+        if (it == candidates.end())
+          break;
+
+        // merge and move last rect to the position of the merged one
+        j = *it;
+        a = combine(a, rects[j]);
+        for_each_cell(a, [&](std::vector<int>& cell) {
+          if (std::find(cell.begin(), cell.end(), ids[i]) == cell.end())
+            cell.push_back(ids[i]);
+        });
+        rects[j] = rects.back();
+        ids[j] = ids[rects.size() - 1];
+        positions[to_unsigned(ids[j])] = j;
+        rects.pop_back();
+        merged = true;
+      }
+    }
+    if (!merged)
+      break;
+  }
+}
+
 std::vector<Rect> find_islands(const Image& image, int merge_distance,
     bool gray_levels, const Rect& rect) {
+  return find_islands(image, OccupancyMap(image, gray_levels, 1),
+    merge_distance, rect);
+}
+
+std::vector<Rect> find_islands(const Image& image, const OccupancyMap& occupancy,
+    int merge_distance, const Rect& rect) {
   if (empty(rect))
-    return find_islands(image, merge_distance, gray_levels,
-      get_used_rect(image, gray_levels));
+    return find_islands(image, occupancy, merge_distance,
+      occupancy.get_used_rect(image.rect()));
+  const auto gray_levels = occupancy.gray_levels();
 
-  auto levels = (gray_levels ?
+  const auto levels = (gray_levels ?
     get_gray_levels(image, rect) :
     get_alpha_levels(image, rect));
-  const auto levels_mono = levels.view<RGBA::Channel>();
-
-  auto islands = std::vector<Rect>();
-  for (auto y = 0; y < rect.h; ++y)
-    for (auto x = 0; x < rect.w; ++x)
-      if (levels_mono.value_at({ x, y })) {
-        auto min_x = x;
-        auto min_y = y;
-        auto max_x = x;
-        auto max_y = y;
-        flood_fill<8>(x, y, rect.w, rect.h,
-          RGBA::Channel{ },
-          [&](int x, int y) -> RGBA::Channel& { 
-            return levels_mono.value_at({ x, y }); 
-          },
-          [&](const RGBA::Channel& pixel) { return (pixel != 0); },
-          [&](int x, int y) {
-            min_x = std::min(x, min_x);
-            min_y = std::min(y, min_y);
-            max_x = std::max(x, max_x);
-            max_y = std::max(y, max_y);
-          });
-        islands.push_back({ rect.x + min_x, rect.y + min_y, max_x - min_x + 1, max_y - min_y + 1 });
-      }
 
-  merge_adjacent_rects(image, islands, merge_distance, gray_levels);
+  auto islands = find_components(levels.view<RGBA::Channel>());
+  for (auto& island : islands) {
+    island.x += rect.x;
+    island.y += rect.y;
+  }
+
+  merge_adjacent_rects(occupancy, islands, merge_distance);
 
   // fuzzy sort from top to bottom, left to right
   const auto center_considerably_less = [](const Rect& a, const Rect& b) {
@@ -549,45 +1149,6 @@ std::vector<Rect> find_islands(const Image& image, int merge_distance,
   return islands;
 }
 
-void clear_alpha(Image& image, RGBA color) {
-  for_each_pixel(image.view<RGBA>(),
-    [&](RGBA& rgba) {
-      if (rgba.a == 0)
-        rgba = color;
-    });
-}
-
-void make_opaque(Image& image) {
-  for_each_pixel(image.view<RGBA>(),
-    [&](RGBA& rgba) {
-      rgba.a = 255;
-    });
-}
-
-void make_opaque(Image& image, RGBA background) {
-  for_each_pixel(image.view<RGBA>(),
-    [&](RGBA& rgba) {
-      if (rgba.a == 0)
-        rgba = background;
-      else
-        rgba.a = 255;
-    });
-}
-
-void premultiply_alpha(Image& image) {
-  const auto image_rgba = image.view<RGBA>();
-  const auto multiply = [](int channel, int alpha) {
-    return RGBA::to_channel(channel * alpha / 255);
-  };
-  const auto size = image_rgba.size();
-  auto rgba = image_rgba.values();
-  for (auto i = 0; i < size; ++i, ++rgba) {
-    rgba->r = multiply(rgba->r, rgba->a);
-    rgba->g = multiply(rgba->g, rgba->a);
-    rgba->b = multiply(rgba->b, rgba->a);
-  }
-}
-
 void bleed_alpha(Image& image) {
   const auto image_rgba = image.view<RGBA>();
   rjm_texbleed(reinterpret_cast<unsigned char*>(image_rgba.values()),
@@ -600,7 +1161,7 @@ Image get_alpha_levels(const Image& image, const Rect& rect) {
     return get_alpha_levels(image, get_used_rect(image, false));
   check_rect(image, rect);
 
-  auto result = Image(ImageType::Mono, rect.w, rect.h);
+  auto result = Image(ImageType::Mono, rect.w, rect.h, ImageStorage::pooled);
   const auto source_rgba = image.view<RGBA>();
   auto dest = result.view<RGBA::Channel>().values();
   for_each_pixel(source_rgba, rect, 
@@ -613,7 +1174,7 @@ Image get_gray_levels(const Image& image, const Rect& rect) {
     return get_gray_levels(image, get_used_rect(image, true));
   check_rect(image, rect);
 
-  auto result = Image(ImageType::Mono, rect.w, rect.h);
+  auto result = Image(ImageType::Mono, rect.w, rect.h, ImageStorage::pooled);
   const auto source_rgba = image.view<RGBA>();
   auto dest = result.view<RGBA::Channel>().values();
   for_each_pixel(source_rgba, rect, 
@@ -634,11 +1195,14 @@ Image resize_image(const Image& image, const SizeF& scale, ScaleFilter filter) {
 
   if (filter == ScaleFilter::point_sample && (scale.x < 1 || scale.y < 1)) {
     // stbir cannot downsample without blending colors?
-    const auto image_rgbaf = image.view<const RGBAF>();
-    return downsample_image_median(image_rgbaf, scale);
+    auto output = Image();
+    image.view([&](auto image_view) {
+      output = downsample_image_median(image_view, scale);
+    });
+    return output;
   }
 
-  auto output = Image(image.type(), width, height);
+  auto output = Image(image.type(), width, height, image.storage());
   auto data_type = stbir_datatype{ };
   auto pixel_layout = stbir_pixel_layout{ };
   switch (image.type()) {
@@ -650,6 +1214,10 @@ Image resize_image(const Image& image, const SizeF& scale, ScaleFilter filter) {
       pixel_layout = STBIR_RGBA;
       data_type = STBIR_TYPE_FLOAT;
       break;
+    case ImageType::RGBA16:
+      pixel_layout = STBIR_RGBA;
+      data_type = STBIR_TYPE_UINT16;
+      break;
     case ImageType::Mono:
       pixel_layout = STBIR_1CHANNEL;
       data_type = STBIR_TYPE_UINT8;
@@ -657,38 +1225,33 @@ Image resize_image(const Image& image, const SizeF& scale, ScaleFilter filter) {
   }
   const auto edge_mode = STBIR_EDGE_CLAMP;
   const auto bytes_per_pixel = static_cast<int>(get_pixel_size(image.type()));
-  if (!stbir_resize(image.data().data(),
-        image.width(), image.height(), image.width() * bytes_per_pixel,
-        output.data().data(), width, height, width * bytes_per_pixel,
-        pixel_layout, data_type, edge_mode, static_cast<stbir_filter>(filter)))
+  auto resize = STBIR_RESIZE{ };
+  stbir_resize_init(&resize, image.data().data(),
+    image.width(), image.height(), image.width() * bytes_per_pixel,
+    output.data().data(), width, height, width * bytes_per_pixel,
+    pixel_layout, data_type);
+  stbir_set_edgemodes(&resize, edge_mode, edge_mode);
+  stbir_set_filters(&resize, static_cast<stbir_filter>(filter),
+    static_cast<stbir_filter>(filter));
+
+  // splits of the output are resized independently, with identical result
+  const auto pixels = std::max(int64_t{ image.width() } * image.height(),
+                               int64_t{ width } * height);
+  const auto try_splits = static_cast<int>(std::clamp(
+    pixels / parallel_resize_pixels, int64_t{ 1 },
+    static_cast<int64_t>(scheduler.thread_count())));
+  const auto splits = stbir_build_samplers_with_splits(&resize, try_splits);
+  auto failed = std::atomic<bool>(splits <= 0);
+  scheduler.for_each_parallel(to_unsigned(std::max(splits, 0)), [&](size_t split) {
+    if (!stbir_resize_extended_split(&resize, to_int(split), 1))
+      failed = true;
+  });
+  stbir_free_samplers(&resize);
+  if (failed)
     throw std::runtime_error("resizing image failed");
   return output;
 }
 
-Image convert_to_linear(const Image& image, const Rect& rect) {
-  if (empty(rect))
-    return convert_to_linear(image, image.rect());
-  check_rect(image, rect);
-
-  auto result = Image(ImageType::RGBAF, rect.w, rect.h);
-  auto dest = result.view<RGBAF>().values();
-  for_each_pixel(image.view<RGBA>(), rect, 
-    [&](const RGBA& c) { *dest++ = srgb_to_linear(c); });
-  return result;
-}
-
-Image convert_to_srgb(const Image& image, const Rect& rect) {
-  if (empty(rect))
-    return convert_to_srgb(image, image.rect());
-  check_rect(image, rect);
-
-  auto result = Image(ImageType::RGBA, rect.w, rect.h);
-  auto dest = result.view<RGBA>().values();
-  for_each_pixel(image.view<RGBAF>(), rect,
-    [&](const RGBAF& c) { *dest++ = linear_to_srgb(c); });
-  return result;
-}
-
 Image rotate_image(const Image& image, real angle, RGBA background, RotateMethod method) {
   angle = std::fmod(std::fmod(angle, 360) + 360, 360);
 
@@ -697,19 +1260,29 @@ Image rotate_image(const Image& image, real angle, RGBA background, RotateMethod
     if (std::abs(std::fmod(angle, 90)) < 0.0001)
       method = RotateMethod::nearest;
   }
+  const auto quarters = round_to_int(angle / 90);
+  const auto multiple_of_90 = (std::abs(angle - quarters * 90) < 0.0001);
   angle = deg_to_rad(angle);
 
-  const auto image_rgbaf = image.view<const RGBAF>();
-  const auto background_rgbaf = srgb_to_linear(background);
-  switch (method) {
-    case RotateMethod::undefined:
-    case RotateMethod::nearest:
-      return rotate_image_nearest(image_rgbaf, angle, background_rgbaf);
+  const auto rotate = [&](auto image_view) {
+    using T = std::remove_const_t<typename decltype(image_view)::Value>;
+    if (multiple_of_90)
+      return rotate_image_90(image_view, quarters % 4);
 
-    case RotateMethod::bilinear:
-      return rotate_image_bilinear(image_rgbaf, angle, background_rgbaf);
-  }
-  return { };
+    const auto background_linear = from_rgbaf<T>(srgb_to_linear(background));
+    switch (method) {
+      case RotateMethod::undefined:
+      case RotateMethod::nearest:
+        return rotate_image_nearest(image_view, angle, background_linear);
+
+      case RotateMethod::bilinear:
+        return rotate_image_bilinear(image_view, angle, background_linear);
+    }
+    return Image();
+  };
+  if (image.type() == ImageType::RGBAF)
+    return rotate(image.view<RGBAF>());
+  return rotate(image.view<RGBA16>());
 }
 
 } // namespace
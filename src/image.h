@@ -9,34 +9,59 @@ template<typename T> class ImageView;
 enum class ImageType {
   RGBA,
   RGBAF,
+  RGBA16,
   Mono
 };
 
 template<typename T> ImageType get_image_type() = delete;
 template<> inline ImageType get_image_type<RGBA>() { return ImageType::RGBA; }
 template<> inline ImageType get_image_type<RGBAF>() { return ImageType::RGBAF; }
+template<> inline ImageType get_image_type<RGBA16>() { return ImageType::RGBA16; }
 template<> inline ImageType get_image_type<RGBA::Channel>() { return ImageType::Mono; }
 
 inline size_t get_pixel_size(ImageType type) {
   switch (type) {
     case ImageType::RGBA:  return 4 * sizeof(uint8_t);
     case ImageType::RGBAF: return 4 * sizeof(float);
+    case ImageType::RGBA16: return 4 * sizeof(uint16_t);
     case ImageType::Mono:  return 1 * sizeof(uint8_t);
   }
   return 0;
 }
 
+enum class ImageStorage {
+  heap,
+  pooled, // recycled by a thread local pool, for transient images
+};
+
+// thread local pool of buffers in size classes
+std::byte* allocate_pooled(size_t size_bytes, size_t* size_class);
+void release_pooled(std::byte* data, size_t size_class);
+// limits idle buffers of all threads
+constexpr auto default_buffer_pool_limit = size_t{ 256 * 1024 * 1024 };
+void set_buffer_pool_limit(size_t bytes);
+size_t get_pooled_bytes();
+
 class Image {
 public:
+  // releases data, which was not allocated by image
+  struct Deleter {
+    void (*release)(std::byte* data, size_t context);
+    size_t context;
+    void operator()(std::byte* data) const { release(data, context); }
+  };
+
   Image() = default;
   
-  Image(ImageType type, int width, int height)
+  Image(ImageType type, int width, int height,
+      ImageStorage storage = ImageStorage::heap)
     : m_type(type), m_width(width), m_height(height),
-      m_data(new std::byte[size_bytes()]) {
+      m_data(allocate(size_bytes(), storage)) {
   }
 
-  Image(ImageType type, int width, int height, std::byte* data)
-    : m_type(type), m_width(width), m_height(height), m_data(data) {
+  Image(ImageType type, int width, int height, std::byte* data, Deleter deleter)
+    : m_type(type), m_width(width), m_height(height), 
+      m_data(data, deleter) {
   }
 
   template<typename T>
@@ -73,16 +98,32 @@ public:
   span<std::byte> data() { return { m_data.get(), size_bytes() }; }
   size_t size_bytes() const { return static_cast<size_t>(m_width * m_height) * pixel_size(); }
   size_t pixel_size() const { return get_pixel_size(m_type); }
+  ImageStorage storage() const {
+    return (m_data.get_deleter().release == &release_pooled ?
+      ImageStorage::pooled : ImageStorage::heap);
+  }
   template<typename T> auto view() const { return ImageView<const T>(this); }
   template<typename T> auto view() { return ImageView<T>(this); }
   template<typename F> void view(F&& func) const;
   template<typename F> void view(F&& func);
 
 private:
+  static void delete_data(std::byte* data, size_t) { delete[] data; }
+
+  static std::unique_ptr<std::byte[], Deleter> allocate(
+      size_t size_bytes, ImageStorage storage) {
+    if (storage == ImageStorage::pooled) {
+      auto size_class = size_t{ };
+      if (auto data = allocate_pooled(size_bytes, &size_class))
+        return { data, Deleter{ &release_pooled, size_class } };
+    }
+    return { new std::byte[size_bytes], Deleter{ &delete_data, 0 } };
+  }
+
   ImageType m_type{ };
   int m_width{ };
   int m_height{ };
-  std::unique_ptr<std::byte[]> m_data;
+  std::unique_ptr<std::byte[], Deleter> m_data;
 };
 
 template<typename T>
@@ -108,6 +149,7 @@ public:
   int size() const { return width() * height(); }
   size_t size_bytes() const { return m_image->size_bytes(); }
   size_t pixel_size() const { return m_image->pixel_size(); }
+  ImageStorage storage() const { return m_image->storage(); }
 
 private:
   ImagePtr m_image{ };
@@ -127,6 +169,20 @@ enum class ScaleFilter {
   point_sample, // Simple point sampling
 };
 
+enum class Compression {
+  default_,
+  fast,
+  max,
+};
+
+enum class PixelFilter {
+  none,
+  make_opaque,
+  clear_alpha,
+  colorkey,
+  premultiply_alpha,
+};
+
 enum class RotateMethod {
   undefined,
   nearest,
@@ -152,6 +208,7 @@ void Image::view(F&& func) const {
   switch (type()) {
     case ImageType::RGBA: return func(view<RGBA>());
     case ImageType::RGBAF: return func(view<RGBAF>());
+    case ImageType::RGBA16: return func(view<RGBA16>());
     case ImageType::Mono: return func(view<RGBA::Channel>());
   }
 }
@@ -161,6 +218,7 @@ void Image::view(F&& func) {
   switch (type()) {
     case ImageType::RGBA: return func(view<RGBA>());
     case ImageType::RGBAF: return func(view<RGBAF>());
+    case ImageType::RGBA16: return func(view<RGBA16>());
     case ImageType::Mono: return func(view<RGBA::Channel>());
   }
 }
@@ -175,10 +233,45 @@ void check_rect(const ImageOrView& image, const Rect& rect) {
   check(containing(image.rect(), rect));
 }
 
+// 1 bit per pixel mask of the pixels, which are not below a threshold
+class OccupancyMap {
+public:
+  OccupancyMap(const Image& image, bool gray_levels, int threshold);
+
+  bool gray_levels() const { return m_gray_levels; }
+  int threshold() const { return m_threshold; }
+  bool is_empty(const Rect& rect) const;
+  Rect get_used_rect(const Rect& rect) const;
+
+private:
+  uint64_t* row_words(int y);
+  const uint64_t* row_words(int y) const;
+  int find_first(int y, int begin, int end) const;
+  int find_last(int y, int begin, int end) const;
+
+  bool m_gray_levels;
+  int m_threshold;
+  int m_width;
+  int m_height;
+  size_t m_row_words;
+  std::vector<uint64_t> m_bits;
+  std::vector<int> m_row_min_x;
+  std::vector<int> m_row_max_x;
+};
+
 // io
 Image load_image(const std::filesystem::path& filename);
+std::vector<std::byte> read_image_file(const std::filesystem::path& filename);
+Image load_image(const std::filesystem::path& filename,
+  const std::vector<std::byte>& file_data);
 void load_image_header(const std::filesystem::path& filename, int* width, int* height);
-void save_image(const Image& image, const std::filesystem::path& filename);
+void set_image_cache_path(std::filesystem::path path);
+const std::filesystem::path& get_image_cache_path();
+Image load_cached_image(const std::filesystem::path& filename);
+void save_image(const Image& image, const std::filesystem::path& filename,
+  Compression compression = Compression::default_);
+bool write_png(const std::filesystem::path& filename, const Image& image,
+  Compression compression);
 void save_animation(const Animation& animation, const std::filesystem::path& filename);
 
 // draw
@@ -204,19 +297,26 @@ bool is_opaque(const Image& image, const Rect& rect = { });
 bool is_fully_transparent(const Image& image, int threshold = 1, const Rect& rect = { });
 bool is_fully_black(const Image& image, int threshold = 1, const Rect& rect = { });
 bool is_identical(const Image& image_a, const Rect& rect_a, const Image& image_b, const Rect& rect_b);
+uint64_t get_hash(const Image& image, const Rect& rect);
 Rect get_used_rect(const Image& image, bool gray_levels, int threshold = 1, const Rect& rect = { });
 RGBA guess_colorkey(const Image& image);
 void replace_color(Image& image, RGBA original, RGBA color);
+void merge_adjacent_rects(const OccupancyMap& occupancy,
+  std::vector<Rect>& rects, int distance);
 std::vector<Rect> find_islands(const Image& image, int merge_distance, 
   bool gray_levels, const Rect& rect = { });
+std::vector<Rect> find_islands(const Image& image, const OccupancyMap& occupancy,
+  int merge_distance, const Rect& rect = { });
 void clear_alpha(Image& image, RGBA color);
 void make_opaque(Image& image);
 void make_opaque(Image& image, RGBA background);
 void premultiply_alpha(Image& image);
 void bleed_alpha(Image& image);
+void apply_pixel_filter(Image& image, PixelFilter filter, RGBA color = { });
 Image get_alpha_levels(const Image& image, const Rect& rect = { });
 Image get_gray_levels(const Image& image, const Rect& rect = { });
-Image convert_to_linear(const Image& image, const Rect& rect = { });
+Image convert_to_linear(const Image& image, const Rect& rect = { },
+  PixelFilter filter = PixelFilter::none, RGBA color = { });
 Image convert_to_srgb(const Image& image, const Rect& rect = { });
 Image rotate_image(const Image& source, real angle, RGBA background, RotateMethod method);
 
@@ -0,0 +1,270 @@
+
+#include "image.h"
+#include "stb/stb_image.h"
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+#if defined(_WIN32)
+# include <process.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+namespace spright {
+
+namespace {
+  // entry is a header followed by the decoded RGBA pixels and the
+  // source path, which identifies the source in case names collide
+  struct EntryHeader {
+    char magic[8];
+    uint64_t file_size;
+    int64_t file_time;
+    uint64_t content_hash;
+    int32_t width;
+    int32_t height;
+    uint32_t path_size;
+    uint8_t reserved[20];
+  };
+  static_assert(sizeof(EntryHeader) == 64);
+
+  const char entry_magic[8] = { 'S', 'P', 'R', 'C', 'A', 'C', 'H', '2' };
+
+  std::filesystem::path g_cache_path;
+
+  // FNV-1a like, but consuming 8 bytes at a time
+  uint64_t get_hash(const std::byte* data, size_t size) {
+    const auto prime = uint64_t{ 0x100000001B3 };
+    auto hash = uint64_t{ 0xCBF29CE484222325 };
+    const auto add = [&](uint64_t value) {
+      hash = (hash ^ value) * prime;
+    };
+    add(size);
+    auto i = size_t{ };
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+      auto value = uint64_t{ };
+      std::memcpy(&value, data + i, sizeof(uint64_t));
+      add(value);
+    }
+    if (i < size) {
+      auto value = uint64_t{ };
+      std::memcpy(&value, data + i, size - i);
+      add(value);
+    }
+    return hash;
+  }
+
+  std::string get_source_path(const std::filesystem::path& filename) {
+    auto error = std::error_code{ };
+    return path_to_utf8(std::filesystem::absolute(filename, error));
+  }
+
+  std::filesystem::path get_entry_filename(const std::string& source_path) {
+    auto ss = std::stringstream();
+    ss << std::hex << std::setw(16) << std::setfill('0') <<
+      get_hash(reinterpret_cast<const std::byte*>(source_path.data()),
+        source_path.size());
+    return g_cache_path / (ss.str() + ".rgba");
+  }
+
+  int get_process_id() {
+#if defined(_WIN32)
+    return _getpid();
+#else
+    return static_cast<int>(::getpid());
+#endif
+  }
+
+  std::vector<std::byte> read_file(const std::filesystem::path& filename,
+      size_t size) {
+    auto is = std::ifstream(filename, std::ios::binary);
+    auto data = std::vector<std::byte>(size);
+    is.read(reinterpret_cast<char*>(data.data()),
+      static_cast<std::streamsize>(size));
+    if (!is.good())
+      return { };
+    return data;
+  }
+
+  struct MappedFile {
+    std::byte* data;
+    size_t size;
+  };
+
+#if !defined(_WIN32)
+  // mapped copy on write, so pixels can still be modified
+  MappedFile map_file(const std::filesystem::path& filename) {
+    const auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return { };
+    struct stat status{ };
+    auto data = MAP_FAILED;
+    if (::fstat(fd, &status) == 0 && status.st_size > 0)
+      data = ::mmap(nullptr, static_cast<size_t>(status.st_size),
+        PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+      return { };
+    return { static_cast<std::byte*>(data), static_cast<size_t>(status.st_size) };
+  }
+
+  void unmap_file(std::byte* data, size_t size) {
+    ::munmap(data, size);
+  }
+#else
+  // there is no mapping yet, but it still skips the decoding
+  MappedFile map_file(const std::filesystem::path& filename) {
+    auto error = std::error_code{ };
+    const auto size = std::filesystem::file_size(filename, error);
+    if (error || !size)
+      return { };
+    auto data = read_file(filename, size);
+    if (data.empty())
+      return { };
+    auto copy = new std::byte[size];
+    std::memcpy(copy, data.data(), size);
+    return { copy, size };
+  }
+
+  void unmap_file(std::byte* data, size_t) {
+    delete[] data;
+  }
+#endif
+
+  bool is_valid_entry(const MappedFile& file, const EntryHeader& header,
+      const std::string& source_path) {
+    if (std::memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0 ||
+        header.width <= 0 || header.height <= 0 ||
+        header.path_size != source_path.size())
+      return false;
+    const auto pixels_size = static_cast<size_t>(header.width) *
+      static_cast<size_t>(header.height) * sizeof(RGBA);
+    const auto path_offset = sizeof(EntryHeader) + pixels_size;
+    return (file.size == path_offset + source_path.size() &&
+      std::memcmp(file.data + path_offset, source_path.data(),
+        source_path.size()) == 0);
+  }
+
+  Image get_entry_image(const MappedFile& file, const EntryHeader& header) {
+    return Image(ImageType::RGBA, header.width, header.height,
+      file.data + sizeof(EntryHeader), Image::Deleter{
+        [](std::byte* data, size_t size) {
+          unmap_file(data - sizeof(EntryHeader), size);
+        }, file.size });
+  }
+
+  void update_entry_time(const std::filesystem::path& entry_filename,
+      int64_t file_time) {
+    auto os = std::fstream(entry_filename,
+      std::ios::binary | std::ios::in | std::ios::out);
+    os.seekp(offsetof(EntryHeader, file_time));
+    os.write(reinterpret_cast<const char*>(&file_time), sizeof(file_time));
+  }
+
+  // written to a temporary file first, since other processes might read it
+  void write_entry(const std::filesystem::path& entry_filename,
+      const EntryHeader& header, const Image& image,
+      const std::string& source_path) {
+    auto ss = std::stringstream();
+    ss << "." << get_process_id() << "-" << std::this_thread::get_id() << ".tmp";
+    auto temp_filename = entry_filename;
+    temp_filename += ss.str();
+    auto error = std::error_code{ };
+    {
+      auto os = std::ofstream(temp_filename, std::ios::binary);
+      os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      os.write(reinterpret_cast<const char*>(image.data().data()),
+        static_cast<std::streamsize>(image.size_bytes()));
+      os.write(source_path.data(),
+        static_cast<std::streamsize>(source_path.size()));
+      if (!os.good()) {
+        os.close();
+        std::filesystem::remove(temp_filename, error);
+        return;
+      }
+    }
+    std::filesystem::rename(temp_filename, entry_filename, error);
+    if (error)
+      std::filesystem::remove(temp_filename, error);
+  }
+} // namespace
+
+void set_image_cache_path(std::filesystem::path path) {
+  if (!path.empty()) {
+    auto error = std::error_code{ };
+    std::filesystem::create_directories(path, error);
+    if (error)
+      throw std::runtime_error("creating cache directory '" +
+        path_to_utf8(path) + "' failed");
+  }
+  g_cache_path = std::move(path);
+}
+
+const std::filesystem::path& get_image_cache_path() {
+  return g_cache_path;
+}
+
+Image load_cached_image(const std::filesystem::path& filename) {
+  if (g_cache_path.empty())
+    return { };
+
+  auto error = std::error_code{ };
+  const auto file_size = std::filesystem::file_size(filename, error);
+  const auto file_time = static_cast<int64_t>(std::filesystem::last_write_time(
+    filename, error).time_since_epoch().count());
+  if (error)
+    return { };
+
+  const auto source_path = get_source_path(filename);
+  const auto entry_filename = get_entry_filename(source_path);
+  auto header = EntryHeader{ };
+  if (const auto entry = map_file(entry_filename); entry.data) {
+    if (entry.size >= sizeof(EntryHeader))
+      std::memcpy(&header, entry.data, sizeof(EntryHeader));
+    if (is_valid_entry(entry, header, source_path) &&
+        header.file_size == file_size) {
+      if (header.file_time == file_time)
+        return get_entry_image(entry, header);
+
+      // file was touched, check if content changed
+      const auto data = read_file(filename, file_size);
+      if (!data.empty() && header.content_hash == get_hash(data.data(), data.size())) {
+        update_entry_time(entry_filename, file_time);
+        return get_entry_image(entry, header);
+      }
+    }
+    unmap_file(entry.data, entry.size);
+  }
+
+  const auto data = read_file(filename, file_size);
+  if (data.empty())
+    return { };
+  auto width = 0;
+  auto height = 0;
+  auto channels = 0;
+  const auto pixels = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(data.data()), static_cast<int>(data.size()),
+    &width, &height, &channels, sizeof(RGBA)));
+  if (!pixels)
+    return { };
+  auto image = Image(ImageType::RGBA, width, height, pixels,
+    Image::Deleter{ [](std::byte* pixels, size_t) { stbi_image_free(pixels); }, 0 });
+
+  header = EntryHeader{ };
+  std::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+  header.file_size = file_size;
+  header.file_time = file_time;
+  header.content_hash = get_hash(data.data(), data.size());
+  header.width = width;
+  header.height = height;
+  header.path_size = static_cast<uint32_t>(source_path.size());
+  write_entry(entry_filename, header, image, source_path);
+  return image;
+}
+
+} // namespace
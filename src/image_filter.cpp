@@ -0,0 +1,220 @@
+
+#include "image.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define SPRIGHT_SSE2
+# include <emmintrin.h>
+#endif
+
+namespace spright {
+
+namespace {
+  // rows of a band should stay in cache between fused steps
+  const auto band_bytes = size_t{ 256 * 1024 };
+
+  template<typename F> // F(int y0, int y1)
+  void for_each_row_band(const Image& image, F&& func) {
+    const auto row_bytes = to_unsigned(image.width()) * sizeof(RGBA16);
+    const auto band_rows = std::max(to_int(band_bytes / std::max(row_bytes, size_t{ 1 })), 1);
+    const auto bands = (image.height() + band_rows - 1) / band_rows;
+    scheduler.for_each_parallel(to_unsigned(bands), [&](size_t band) {
+      const auto y0 = to_int(band) * band_rows;
+      func(y0, std::min(y0 + band_rows, image.height()));
+    });
+  }
+
+  constexpr auto alpha_mask = uint32_t{ 0xFF000000 };
+
+#if defined(SPRIGHT_SSE2)
+  uint32_t to_uint32(const RGBA& rgba) {
+    return (uint32_t{ rgba.r } << 0) | (uint32_t{ rgba.g } << 8) |
+           (uint32_t{ rgba.b } << 16) | (uint32_t{ rgba.a } << 24);
+  }
+
+  __m128i load(const RGBA* pixels) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels));
+  }
+
+  void store(RGBA* pixels, __m128i value) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels), value);
+  }
+
+  // selects color where pixel is fully transparent, pixel | or_mask otherwise
+  int replace_transparent_sse2(RGBA* pixels, int count,
+      const RGBA& color, uint32_t or_mask) {
+    const auto alpha = _mm_set1_epi32(static_cast<int>(alpha_mask));
+    const auto replacement = _mm_set1_epi32(static_cast<int>(to_uint32(color)));
+    const auto or_value = _mm_set1_epi32(static_cast<int>(or_mask));
+    auto i = 0;
+    for (; i + 4 <= count; i += 4) {
+      const auto v = load(pixels + i);
+      const auto transparent = _mm_cmpeq_epi32(
+        _mm_and_si128(v, alpha), _mm_setzero_si128());
+      store(pixels + i, _mm_or_si128(
+        _mm_and_si128(transparent, replacement),
+        _mm_andnot_si128(transparent, _mm_or_si128(v, or_value))));
+    }
+    return i;
+  }
+
+  int make_opaque_sse2(RGBA* pixels, int count) {
+    const auto alpha = _mm_set1_epi32(static_cast<int>(alpha_mask));
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+      store(pixels + i, _mm_or_si128(load(pixels + i), alpha));
+    return i;
+  }
+
+  // channel * alpha / 255, using that x / 255 == (x * 0x8081) >> 23
+  __m128i premultiply_sse2(__m128i v) {
+    const auto shuffle_alpha = [](__m128i v) {
+      return _mm_shufflehi_epi16(_mm_shufflelo_epi16(v,
+        _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    };
+    const auto divisor = _mm_set1_epi16(static_cast<short>(0x8081));
+    const auto multiply = [&](__m128i v) {
+      return _mm_srli_epi16(_mm_mulhi_epu16(
+        _mm_mullo_epi16(v, shuffle_alpha(v)), divisor), 7);
+    };
+    const auto zero = _mm_setzero_si128();
+    const auto lo = multiply(_mm_unpacklo_epi8(v, zero));
+    const auto hi = multiply(_mm_unpackhi_epi8(v, zero));
+    const auto alpha = _mm_set1_epi32(static_cast<int>(alpha_mask));
+    return _mm_or_si128(_mm_andnot_si128(alpha, _mm_packus_epi16(lo, hi)),
+      _mm_and_si128(v, alpha));
+  }
+
+  int premultiply_alpha_sse2(RGBA* pixels, int count) {
+    auto i = 0;
+    for (; i + 4 <= count; i += 4)
+      store(pixels + i, premultiply_sse2(load(pixels + i)));
+    return i;
+  }
+#endif // SPRIGHT_SSE2
+
+  void apply_pixel_filter(RGBA* pixels, int count,
+      PixelFilter filter, const RGBA& color) {
+    auto i = 0;
+    switch (filter) {
+      case PixelFilter::none:
+        break;
+
+      case PixelFilter::make_opaque:
+#if defined(SPRIGHT_SSE2)
+        i = make_opaque_sse2(pixels, count);
+#endif
+        for (; i < count; ++i)
+          pixels[i].a = 255;
+        break;
+
+      case PixelFilter::clear_alpha:
+#if defined(SPRIGHT_SSE2)
+        i = replace_transparent_sse2(pixels, count, color, 0);
+#endif
+        for (; i < count; ++i)
+          if (pixels[i].a == 0)
+            pixels[i] = color;
+        break;
+
+      case PixelFilter::colorkey:
+#if defined(SPRIGHT_SSE2)
+        i = replace_transparent_sse2(pixels, count, color, alpha_mask);
+#endif
+        for (; i < count; ++i) {
+          if (pixels[i].a == 0)
+            pixels[i] = color;
+          else
+            pixels[i].a = 255;
+        }
+        break;
+
+      case PixelFilter::premultiply_alpha:
+#if defined(SPRIGHT_SSE2)
+        i = premultiply_alpha_sse2(pixels, count);
+#endif
+        for (; i < count; ++i) {
+          auto& rgba = pixels[i];
+          rgba.r = RGBA::to_channel(rgba.r * rgba.a / 255);
+          rgba.g = RGBA::to_channel(rgba.g * rgba.a / 255);
+          rgba.b = RGBA::to_channel(rgba.b * rgba.a / 255);
+        }
+        break;
+    }
+  }
+} // namespace
+
+void apply_pixel_filter(Image& image, PixelFilter filter, RGBA color) {
+  if (filter == PixelFilter::none)
+    return;
+  const auto image_rgba = image.view<RGBA>();
+  for_each_row_band(image, [&](int y0, int y1) {
+    apply_pixel_filter(image_rgba.values_at(0, y0),
+      (y1 - y0) * image.width(), filter, color);
+  });
+}
+
+void clear_alpha(Image& image, RGBA color) {
+  apply_pixel_filter(image, PixelFilter::clear_alpha, color);
+}
+
+void make_opaque(Image& image) {
+  apply_pixel_filter(image, PixelFilter::make_opaque);
+}
+
+void make_opaque(Image& image, RGBA background) {
+  apply_pixel_filter(image, PixelFilter::colorkey, background);
+}
+
+void premultiply_alpha(Image& image) {
+  apply_pixel_filter(image, PixelFilter::premultiply_alpha);
+}
+
+Image convert_to_linear(const Image& image, const Rect& rect,
+    PixelFilter filter, RGBA color) {
+  if (empty(rect))
+    return convert_to_linear(image, image.rect(), filter, color);
+  check_rect(image, rect);
+
+  // linear images are only intermediate
+  auto result = Image(ImageType::RGBA16, rect.w, rect.h, ImageStorage::pooled);
+  const auto source_rgba = image.view<RGBA>();
+  const auto dest_rgba16 = result.view<RGBA16>();
+  for_each_row_band(result, [&](int y0, int y1) {
+    auto row = std::vector<RGBA>(to_unsigned(rect.w));
+    for (auto y = y0; y < y1; ++y) {
+      const auto source = source_rgba.values_at(rect.x, rect.y + y);
+      std::copy_n(source, rect.w, row.data());
+      apply_pixel_filter(row.data(), rect.w, filter, color);
+      std::transform(row.begin(), row.end(), dest_rgba16.values_at(0, y),
+        [](const RGBA& c) { return srgb_to_linear16(c); });
+    }
+  });
+  return result;
+}
+
+Image convert_to_srgb(const Image& image, const Rect& rect) {
+  if (empty(rect))
+    return convert_to_srgb(image, image.rect());
+  check_rect(image, rect);
+
+  auto result = Image(ImageType::RGBA, rect.w, rect.h);
+  const auto dest_rgba = result.view<RGBA>();
+  for_each_row_band(result, [&](int y0, int y1) {
+    for (auto y = y0; y < y1; ++y) {
+      const auto dest = dest_rgba.values_at(0, y);
+      if (image.type() == ImageType::RGBAF) {
+        const auto source = image.view<RGBAF>().values_at(rect.x, rect.y + y);
+        std::transform(source, source + rect.w, dest,
+          [](const RGBAF& c) { return linear_to_srgb(c); });
+      }
+      else {
+        const auto source = image.view<RGBA16>().values_at(rect.x, rect.y + y);
+        std::transform(source, source + rect.w, dest,
+          [](const RGBA16& c) { return linear16_to_srgb(c); });
+      }
+    }
+  });
+  return result;
+}
+
+} // namespace
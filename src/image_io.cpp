@@ -7,6 +7,7 @@
 #include <algorithm>
 #include <stdexcept>
 #include <cstring>
+#include <fstream>
 #include <utility>
 
 namespace spright {
@@ -284,6 +285,9 @@ namespace {
 } // namespace
 
 Image load_image(const std::filesystem::path& filename) {
+  if (auto image = load_cached_image(filename))
+    return image;
+
   auto width = 0;
   auto height = 0;
   auto data = std::add_pointer_t<std::byte>{ };
@@ -314,7 +318,45 @@ Image load_image(const std::filesystem::path& filename) {
     throw std::runtime_error("loading file '" +
       path_to_utf8(filename) + "' failed");
 
-  return Image(ImageType::RGBA, width, height, data);
+  return Image(ImageType::RGBA, width, height, data, Image::Deleter{
+    [](std::byte* data, size_t) { stbi_image_free(data); }, 0 });
+}
+
+std::vector<std::byte> read_image_file(const std::filesystem::path& filename) {
+  // the image cache reads the file itself, when it has no entry
+  if (!get_image_cache_path().empty())
+    return { };
+
+  auto error = std::error_code{ };
+  const auto size = std::filesystem::file_size(filename, error);
+  if (error)
+    return { };
+  auto data = std::vector<std::byte>(size);
+  auto file = std::ifstream(filename, std::ios::binary);
+  file.read(reinterpret_cast<char*>(data.data()),
+    static_cast<std::streamsize>(size));
+  if (!file.good())
+    return { };
+  return data;
+}
+
+Image load_image(const std::filesystem::path& filename,
+    const std::vector<std::byte>& file_data) {
+  if (file_data.empty())
+    return load_image(filename);
+
+  auto width = 0;
+  auto height = 0;
+  auto channels = 0;
+  const auto data = reinterpret_cast<std::byte*>(stbi_load_from_memory(
+    reinterpret_cast<const stbi_uc*>(file_data.data()),
+    static_cast<int>(file_data.size()), &width, &height, &channels, sizeof(RGBA)));
+  if (!data)
+    throw std::runtime_error("loading file '" +
+      path_to_utf8(filename) + "' failed");
+
+  return Image(ImageType::RGBA, width, height, data, Image::Deleter{
+    [](std::byte* data, size_t) { stbi_image_free(data); }, 0 });
 }
 
 void load_image_header(const std::filesystem::path& filename, int* width, int* height) {
@@ -341,7 +383,8 @@ void load_image_header(const std::filesystem::path& filename, int* width, int* h
       path_to_utf8(filename) + "' failed");
 }
 
-void save_image(const Image& image, const std::filesystem::path& path) {
+void save_image(const Image& image, const std::filesystem::path& path,
+    Compression compression) {
   if (!path.parent_path().empty())
     std::filesystem::create_directories(path.parent_path());
   const auto filename = path_to_utf8(path);
@@ -353,11 +396,11 @@ void save_image(const Image& image, const std::filesystem::path& path) {
       return write_gif(filename, animation);
     }
 
+    if (extension == ".png" || extension.empty())
+      return write_png(path, image, compression);
+
     const auto comp = to_int(sizeof(RGBA));
     const auto image_rgba = image.view<RGBA>();
-    if (extension == ".png" || extension.empty())
-      return stbi_write_png(filename.c_str(),
-        image.width(), image.height(), comp, image_rgba.values(), 0);
 
     if (extension == ".bmp")
       return stbi_write_bmp(filename.c_str(),
@@ -0,0 +1,210 @@
+
+#include "image.h"
+#include "miniz/miniz.h"
+#include <fstream>
+#include <memory>
+
+namespace spright {
+
+namespace {
+  using Bytes = std::vector<uint8_t>;
+
+  // pieces of the filtered image, which are deflated independently
+  const auto piece_size = size_t{ 1024 * 1024 };
+  const auto filter_band_rows = 64;
+  const auto bytes_per_pixel = size_t{ sizeof(RGBA) };
+
+  int get_deflate_level(Compression compression) {
+    switch (compression) {
+      case Compression::fast: return 1;
+      case Compression::default_: break;
+      case Compression::max: return MZ_UBER_COMPRESSION;
+    }
+    return 8;
+  }
+
+  uint8_t get_zlib_flags(Compression compression) {
+    // FLEVEL field, FCHECK makes header a multiple of 31
+    switch (compression) {
+      case Compression::fast: return 0x01;
+      case Compression::default_: break;
+      case Compression::max: return 0xDA;
+    }
+    return 0x9C;
+  }
+
+  void put_uint32(Bytes& bytes, uint32_t value) {
+    bytes.push_back(static_cast<uint8_t>(value >> 24));
+    bytes.push_back(static_cast<uint8_t>(value >> 16));
+    bytes.push_back(static_cast<uint8_t>(value >> 8));
+    bytes.push_back(static_cast<uint8_t>(value));
+  }
+
+  uint8_t paeth_predictor(int a, int b, int c) {
+    const auto p = a + b - c;
+    const auto pa = std::abs(p - a);
+    const auto pb = std::abs(p - b);
+    const auto pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc)
+      return static_cast<uint8_t>(a);
+    return static_cast<uint8_t>(pb <= pc ? b : c);
+  }
+
+  // applies filter type to row, previous is null for first row
+  void filter_row(int type, const uint8_t* row, const uint8_t* previous,
+      size_t size, uint8_t* output) {
+    for (auto i = size_t{ }; i < size; ++i) {
+      const auto a = (i >= bytes_per_pixel ? row[i - bytes_per_pixel] : 0);
+      const auto b = (previous ? previous[i] : 0);
+      const auto c = (previous && i >= bytes_per_pixel ?
+        previous[i - bytes_per_pixel] : 0);
+      auto predicted = 0;
+      switch (type) {
+        case 1: predicted = a; break;
+        case 2: predicted = b; break;
+        case 3: predicted = (a + b) / 2; break;
+        case 4: predicted = paeth_predictor(a, b, c); break;
+      }
+      output[i] = static_cast<uint8_t>(row[i] - predicted);
+    }
+  }
+
+  // minimum sum of absolute differences heuristic, as used by libpng
+  void filter_row(const uint8_t* row, const uint8_t* previous,
+      size_t size, uint8_t* output, Bytes& candidate) {
+    auto best_sum = std::numeric_limits<uint64_t>::max();
+    for (auto type = 0; type < 5; ++type) {
+      filter_row(type, row, previous, size, candidate.data() + 1);
+      auto sum = uint64_t{ };
+      for (auto i = size_t{ }; i < size; ++i)
+        sum += to_unsigned(std::abs(static_cast<int8_t>(candidate[i + 1])));
+      if (sum < best_sum) {
+        best_sum = sum;
+        candidate[0] = static_cast<uint8_t>(type);
+        std::copy(candidate.begin(), candidate.begin() +
+          static_cast<ptrdiff_t>(size + 1), output);
+      }
+    }
+  }
+
+  Bytes filter_image(const Image& image) {
+    const auto image_rgba = image.view<RGBA>();
+    const auto row_size = to_unsigned(image.width()) * bytes_per_pixel;
+    auto filtered = Bytes((row_size + 1) * to_unsigned(image.height()));
+    const auto bands = (image.height() + filter_band_rows - 1) / filter_band_rows;
+    scheduler.for_each_parallel(to_unsigned(bands), [&](size_t band) {
+      auto candidate = Bytes(row_size + 1);
+      const auto y0 = to_int(band) * filter_band_rows;
+      const auto y1 = std::min(y0 + filter_band_rows, image.height());
+      for (auto y = y0; y < y1; ++y) {
+        const auto row = reinterpret_cast<const uint8_t*>(
+          image_rgba.values_at(0, y));
+        const auto previous = (y > 0 ? reinterpret_cast<const uint8_t*>(
+          image_rgba.values_at(0, y - 1)) : nullptr);
+        filter_row(row, previous, row_size,
+          filtered.data() + to_unsigned(y) * (row_size + 1), candidate);
+      }
+    });
+    return filtered;
+  }
+
+  mz_bool append_bytes(const void* data, int size, void* user) {
+    auto& bytes = *static_cast<Bytes*>(user);
+    const auto begin = static_cast<const uint8_t*>(data);
+    bytes.insert(bytes.end(), begin, begin + size);
+    return MZ_TRUE;
+  }
+
+  // each piece is a byte aligned sequence of raw deflate blocks,
+  // only the last one is marked final
+  bool deflate_piece(const uint8_t* data, size_t size, bool last,
+      int level, Bytes& output) {
+    const auto compressor = std::unique_ptr<tdefl_compressor,
+      decltype(&tdefl_compressor_free)>(tdefl_compressor_alloc(),
+        &tdefl_compressor_free);
+    if (!compressor)
+      return false;
+    const auto flags = static_cast<int>(
+      tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS,
+        MZ_DEFAULT_STRATEGY));
+    if (tdefl_init(compressor.get(), append_bytes, &output, flags) !=
+        TDEFL_STATUS_OKAY)
+      return false;
+    const auto status = tdefl_compress_buffer(compressor.get(), data, size,
+      last ? TDEFL_FINISH : TDEFL_SYNC_FLUSH);
+    return (status == (last ? TDEFL_STATUS_DONE : TDEFL_STATUS_OKAY));
+  }
+
+  // zlib stream split into pieces, which were compressed in parallel
+  std::vector<Bytes> compress_zlib(const Bytes& data, Compression compression) {
+    const auto count = std::max((data.size() + piece_size - 1) / piece_size,
+      size_t{ 1 });
+    auto pieces = std::vector<Bytes>(count);
+    auto failed = std::atomic<bool>{ };
+    const auto level = get_deflate_level(compression);
+    scheduler.for_each_parallel(count, [&](size_t i) {
+      const auto begin = i * piece_size;
+      const auto size = std::min(piece_size, data.size() - begin);
+      if (!deflate_piece(data.data() + begin, size, i == count - 1,
+          level, pieces[i]))
+        failed = true;
+    });
+    if (failed)
+      return { };
+
+    pieces.front().insert(pieces.front().begin(),
+      { 0x78, get_zlib_flags(compression) });
+    put_uint32(pieces.back(), static_cast<uint32_t>(
+      mz_adler32(MZ_ADLER32_INIT, data.data(), data.size())));
+    return pieces;
+  }
+
+  void write_chunk(std::ostream& os, const char* type, const Bytes& data) {
+    auto header = Bytes();
+    put_uint32(header, static_cast<uint32_t>(data.size()));
+    header.insert(header.end(), type, type + 4);
+    auto crc = mz_crc32(MZ_CRC32_INIT, header.data() + 4, 4);
+    crc = mz_crc32(crc, data.data(), data.size());
+    auto footer = Bytes();
+    put_uint32(footer, static_cast<uint32_t>(crc));
+
+    os.write(reinterpret_cast<const char*>(header.data()),
+      static_cast<std::streamsize>(header.size()));
+    os.write(reinterpret_cast<const char*>(data.data()),
+      static_cast<std::streamsize>(data.size()));
+    os.write(reinterpret_cast<const char*>(footer.data()),
+      static_cast<std::streamsize>(footer.size()));
+  }
+} // namespace
+
+// http://www.libpng.org/pub/png/spec/1.2/PNG-Structure.html
+bool write_png(const std::filesystem::path& filename, const Image& image,
+    Compression compression) {
+  if (image.width() <= 0 || image.height() <= 0)
+    return false;
+
+  const auto pieces = compress_zlib(filter_image(image), compression);
+  if (pieces.empty())
+    return false;
+
+  auto os = std::ofstream(filename, std::ios::binary);
+  if (!os.good())
+    return false;
+
+  const uint8_t signature[] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+  os.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+  auto header = Bytes();
+  put_uint32(header, static_cast<uint32_t>(image.width()));
+  put_uint32(header, static_cast<uint32_t>(image.height()));
+  // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+  header.insert(header.end(), { 8, 6, 0, 0, 0 });
+  write_chunk(os, "IHDR", header);
+
+  for (const auto& piece : pieces)
+    write_chunk(os, "IDAT", piece);
+  write_chunk(os, "IEND", { });
+  return os.good();
+}
+
+} // namespace
@@ -0,0 +1,414 @@
+
+#include "image.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+# define SPRIGHT_X86
+# include <immintrin.h>
+# if defined(_MSC_VER)
+#   include <intrin.h>
+#   define TARGET_AVX2
+# else
+#   define TARGET_AVX2 __attribute__((target("avx2")))
+# endif
+#endif
+
+namespace spright {
+
+namespace {
+  // weighted sum of to_gray, compared against threshold * 256
+  int get_gray_sum(const RGBA& rgba) {
+    return rgba.r * 77 + rgba.g * 151 + rgba.b * 28;
+  }
+
+  struct Threshold {
+    bool gray_levels;
+    int value;
+
+    bool used(const RGBA& rgba) const {
+      return (gray_levels ? get_gray_sum(rgba) : rgba.a) >= value;
+    }
+  };
+
+  // scans row for first/last pixel, which is not below threshold,
+  // or sets a bit for each of them
+  struct ScanKernel {
+    int (*find_first)(const RGBA* row, int count, const Threshold& threshold);
+    int (*find_last)(const RGBA* row, int count, const Threshold& threshold);
+    void (*get_used_bits)(const RGBA* row, int count,
+      const Threshold& threshold, uint64_t* words);
+  };
+
+  int count_trailing_zeros(uint64_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    auto index = 0ul;
+    _BitScanForward64(&index, bits);
+    return static_cast<int>(index);
+#else
+    auto count = 0;
+    for (; !(bits & 1u); bits >>= 1)
+      ++count;
+    return count;
+#endif
+  }
+
+  int find_highest_bit(uint64_t bits) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    auto index = 0ul;
+    _BitScanReverse64(&index, bits);
+    return static_cast<int>(index);
+#else
+    auto index = 63;
+    for (; !(bits >> 63); bits <<= 1)
+      --index;
+    return index;
+#endif
+  }
+
+  int find_first_scalar(const RGBA* row, int count, const Threshold& threshold) {
+    for (auto x = 0; x < count; ++x)
+      if (threshold.used(row[x]))
+        return x;
+    return count;
+  }
+
+  int find_last_scalar(const RGBA* row, int count, const Threshold& threshold) {
+    for (auto x = count - 1; x >= 0; --x)
+      if (threshold.used(row[x]))
+        return x;
+    return -1;
+  }
+
+  void set_used_bits(const RGBA* row, int begin, int end,
+      const Threshold& threshold, uint64_t* words) {
+    for (auto x = begin; x < end; ++x)
+      if (threshold.used(row[x]))
+        words[x / 64] |= uint64_t{ 1 } << (x % 64);
+  }
+
+#if !defined(SPRIGHT_X86)
+  void get_used_bits_scalar(const RGBA* row, int count,
+      const Threshold& threshold, uint64_t* words) {
+    set_used_bits(row, 0, count, threshold, words);
+  }
+#endif
+
+  // GetUsedBits returns one bit per used pixel of a block of Block pixels
+  template<int Block, typename GetUsedBits>
+  int find_first_blocks(const RGBA* row, int count,
+      const Threshold& threshold, GetUsedBits&& get_used_bits) {
+    auto x = 0;
+    for (; x + Block <= count; x += Block)
+      if (const auto bits = get_used_bits(row + x))
+        return x + count_trailing_zeros(bits);
+    return x + find_first_scalar(row + x, count - x, threshold);
+  }
+
+  template<int Block, typename GetUsedBits>
+  int find_last_blocks(const RGBA* row, int count,
+      const Threshold& threshold, GetUsedBits&& get_used_bits) {
+    auto x = count;
+    for (; x - Block >= 0; x -= Block)
+      if (const auto bits = get_used_bits(row + x - Block))
+        return x - Block + find_highest_bit(bits);
+    return find_last_scalar(row, x, threshold);
+  }
+
+  template<int Block, typename GetUsedBits>
+  void get_used_bits_blocks(const RGBA* row, int count,
+      const Threshold& threshold, uint64_t* words, GetUsedBits&& get_used_bits) {
+    static_assert(64 % Block == 0);
+    auto x = 0;
+    for (; x + Block <= count; x += Block)
+      words[x / 64] |= uint64_t{ get_used_bits(row + x) } << (x % 64);
+    set_used_bits(row, x, count, threshold, words);
+  }
+
+#if defined(SPRIGHT_X86)
+  // SSE2 is part of x86-64, 16 pixels are tested at once
+  __m128i get_used_mask_sse2(__m128i pixels, const Threshold& threshold) {
+    const auto limit = _mm_set1_epi32(threshold.value - 1);
+    if (!threshold.gray_levels)
+      return _mm_cmpgt_epi32(_mm_srli_epi32(pixels, 24), limit);
+
+    const auto zero = _mm_setzero_si128();
+    const auto weights = _mm_setr_epi16(77, 151, 28, 0, 77, 151, 28, 0);
+    const auto lo = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), weights));
+    const auto hi = _mm_castsi128_ps(_mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), weights));
+    const auto sum = _mm_add_epi32(
+      _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+      _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+    return _mm_cmpgt_epi32(sum, limit);
+  }
+
+  uint32_t get_used_bits_sse2(const RGBA* pixels, const Threshold& threshold) {
+    auto bits = uint32_t{ };
+    for (auto i = 0; i < 4; ++i) {
+      const auto mask = get_used_mask_sse2(_mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(pixels + i * 4)), threshold);
+      bits |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(mask))) <<
+        (i * 4);
+    }
+    return bits;
+  }
+
+  int find_first_sse2(const RGBA* row, int count, const Threshold& threshold) {
+    return find_first_blocks<16>(row, count, threshold,
+      [&](const RGBA* pixels) { return get_used_bits_sse2(pixels, threshold); });
+  }
+
+  int find_last_sse2(const RGBA* row, int count, const Threshold& threshold) {
+    return find_last_blocks<16>(row, count, threshold,
+      [&](const RGBA* pixels) { return get_used_bits_sse2(pixels, threshold); });
+  }
+
+  void get_used_bits_sse2(const RGBA* row, int count,
+      const Threshold& threshold, uint64_t* words) {
+    get_used_bits_blocks<16>(row, count, threshold, words,
+      [&](const RGBA* pixels) { return get_used_bits_sse2(pixels, threshold); });
+  }
+
+  // AVX2 tests 32 pixels at once, 128 bit lanes keep the pixel order
+  TARGET_AVX2 uint32_t get_used_bits_avx2(const RGBA* pixels,
+      const Threshold& threshold) {
+    const auto limit = _mm256_set1_epi32(threshold.value - 1);
+    const auto zero = _mm256_setzero_si256();
+    const auto weights = _mm256_setr_epi16(77, 151, 28, 0, 77, 151, 28, 0,
+                                           77, 151, 28, 0, 77, 151, 28, 0);
+    auto bits = uint32_t{ };
+    for (auto i = 0; i < 4; ++i) {
+      const auto values = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(pixels + i * 8));
+      auto mask = __m256i{ };
+      if (!threshold.gray_levels) {
+        mask = _mm256_cmpgt_epi32(_mm256_srli_epi32(values, 24), limit);
+      }
+      else {
+        const auto lo = _mm256_castsi256_ps(_mm256_madd_epi16(
+          _mm256_unpacklo_epi8(values, zero), weights));
+        const auto hi = _mm256_castsi256_ps(_mm256_madd_epi16(
+          _mm256_unpackhi_epi8(values, zero), weights));
+        const auto sum = _mm256_add_epi32(
+          _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0))),
+          _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1))));
+        mask = _mm256_cmpgt_epi32(sum, limit);
+      }
+      bits |= static_cast<uint32_t>(_mm256_movemask_ps(
+        _mm256_castsi256_ps(mask))) << (i * 8);
+    }
+    return bits;
+  }
+
+  TARGET_AVX2 int find_first_avx2(const RGBA* row, int count,
+      const Threshold& threshold) {
+    return find_first_blocks<32>(row, count, threshold,
+      [&](const RGBA* pixels) { return get_used_bits_avx2(pixels, threshold); });
+  }
+
+  TARGET_AVX2 int find_last_avx2(const RGBA* row, int count,
+      const Threshold& threshold) {
+    return find_last_blocks<32>(row, count, threshold,
+      [&](const RGBA* pixels) { return get_used_bits_avx2(pixels, threshold); });
+  }
+
+  TARGET_AVX2 void get_used_bits_avx2(const RGBA* row, int count,
+      const Threshold& threshold, uint64_t* words) {
+    get_used_bits_blocks<32>(row, count, threshold, words,
+      [&](const RGBA* pixels) { return get_used_bits_avx2(pixels, threshold); });
+  }
+
+  bool has_avx2() {
+# if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const auto os_saves_ymm = ((info[2] & (1 << 27)) &&
+      (_xgetbv(0) & 0x6) == 0x6);
+    __cpuidex(info, 7, 0);
+    return (os_saves_ymm && (info[1] & (1 << 5)));
+# else
+    return __builtin_cpu_supports("avx2");
+# endif
+  }
+#endif // SPRIGHT_X86
+
+  const ScanKernel& get_scan_kernel() {
+    static const auto kernel = []() {
+#if defined(SPRIGHT_X86)
+      if (has_avx2())
+        return ScanKernel{ find_first_avx2, find_last_avx2, get_used_bits_avx2 };
+      return ScanKernel{ find_first_sse2, find_last_sse2, get_used_bits_sse2 };
+#else
+      return ScanKernel{ find_first_scalar, find_last_scalar,
+        get_used_bits_scalar };
+#endif
+    }();
+    return kernel;
+  }
+
+  Threshold get_threshold(bool gray_levels, int threshold) {
+    return { gray_levels, std::clamp(threshold, 0, 256) * (gray_levels ? 256 : 1) };
+  }
+
+  // FindFirst/FindLast return the first/last used x in row y within
+  // [begin, end), otherwise end/begin - 1. Coordinates are relative to rect.
+  template<typename FindFirst, typename FindLast>
+  Rect scan_used_rect(const Rect& rect, FindFirst&& find_first, FindLast&& find_last) {
+    // single pass over rows, only the margins outside the current
+    // column bounds need to be scanned
+    auto min_x = rect.w;
+    auto max_x = -1;
+    auto min_y = -1;
+    auto max_y = -1;
+    for (auto y = 0; y < rect.h; ++y) {
+      if (max_x < 0) {
+        const auto first = find_first(y, 0, rect.w);
+        if (first == rect.w)
+          continue;
+        min_x = first;
+        max_x = find_last(y, first, rect.w);
+      }
+      else {
+        const auto first = find_first(y, 0, min_x);
+        const auto last = find_last(y, max_x + 1, rect.w);
+        if (first == min_x && last == max_x &&
+            find_first(y, min_x, max_x + 1) > max_x)
+          continue;
+        min_x = first;
+        max_x = last;
+      }
+      if (min_y < 0)
+        min_y = y;
+      max_y = y;
+    }
+
+    // keep behavior of scanning towards the bottom-right pixel
+    if (min_y < 0)
+      return { rect.x + rect.w - 1, rect.y + rect.h - 1, 1, 1 };
+
+    return { rect.x + min_x, rect.y + min_y, max_x - min_x + 1, max_y - min_y + 1 };
+  }
+} // namespace
+
+OccupancyMap::OccupancyMap(const Image& image, bool gray_levels, int threshold)
+  : m_gray_levels(gray_levels),
+    m_threshold(threshold),
+    m_width(image.width()),
+    m_height(image.height()),
+    m_row_words(to_unsigned(m_width + 63) / 64),
+    m_bits(m_row_words * to_unsigned(m_height)),
+    m_row_min_x(to_unsigned(m_height), m_width),
+    m_row_max_x(to_unsigned(m_height), -1) {
+
+  const auto limit = get_threshold(gray_levels, threshold);
+  const auto& kernel = get_scan_kernel();
+  const auto image_rgba = image.view<RGBA>();
+  for (auto y = 0; y < m_height; ++y) {
+    const auto words = row_words(y);
+    kernel.get_used_bits(image_rgba.values_at(0, y), m_width, limit, words);
+    for (auto i = size_t{ }; i < m_row_words; ++i)
+      if (words[i]) {
+        m_row_min_x[to_unsigned(y)] = to_int(i) * 64 + count_trailing_zeros(words[i]);
+        break;
+      }
+    for (auto i = m_row_words; i > 0; --i)
+      if (words[i - 1]) {
+        m_row_max_x[to_unsigned(y)] = to_int(i - 1) * 64 + find_highest_bit(words[i - 1]);
+        break;
+      }
+  }
+}
+
+uint64_t* OccupancyMap::row_words(int y) {
+  return m_bits.data() + to_unsigned(y) * m_row_words;
+}
+
+const uint64_t* OccupancyMap::row_words(int y) const {
+  return m_bits.data() + to_unsigned(y) * m_row_words;
+}
+
+int OccupancyMap::find_first(int y, int begin, int end) const {
+  const auto row_min_x = m_row_min_x[to_unsigned(y)];
+  const auto row_max_x = m_row_max_x[to_unsigned(y)];
+  if (begin >= end || row_min_x >= end || row_max_x < begin)
+    return end;
+  if (row_min_x >= begin)
+    return row_min_x;
+
+  const auto words = row_words(y);
+  for (auto i = begin / 64; i <= (end - 1) / 64; ++i) {
+    auto word = words[to_unsigned(i)];
+    if (i == begin / 64)
+      word &= ~uint64_t{ } << (begin % 64);
+    if (word) {
+      const auto x = i * 64 + count_trailing_zeros(word);
+      return std::min(x, end);
+    }
+  }
+  return end;
+}
+
+int OccupancyMap::find_last(int y, int begin, int end) const {
+  const auto row_min_x = m_row_min_x[to_unsigned(y)];
+  const auto row_max_x = m_row_max_x[to_unsigned(y)];
+  if (begin >= end || row_min_x >= end || row_max_x < begin)
+    return begin - 1;
+  if (row_max_x < end)
+    return row_max_x;
+
+  const auto words = row_words(y);
+  for (auto i = (end - 1) / 64; i >= begin / 64; --i) {
+    auto word = words[to_unsigned(i)];
+    if (i == (end - 1) / 64 && end % 64)
+      word &= ~(~uint64_t{ } << (end % 64));
+    if (word) {
+      const auto x = i * 64 + find_highest_bit(word);
+      return std::max(x, begin - 1);
+    }
+  }
+  return begin - 1;
+}
+
+bool OccupancyMap::is_empty(const Rect& rect) const {
+  check(containing(Rect{ 0, 0, m_width, m_height }, rect));
+  for (auto y = rect.y; y < rect.y1(); ++y)
+    if (find_first(y, rect.x, rect.x1()) < rect.x1())
+      return false;
+  return true;
+}
+
+Rect OccupancyMap::get_used_rect(const Rect& rect) const {
+  if (empty(rect))
+    return get_used_rect({ 0, 0, m_width, m_height });
+  check(containing(Rect{ 0, 0, m_width, m_height }, rect));
+  return scan_used_rect(rect,
+    [&](int y, int begin, int end) {
+      return find_first(rect.y + y, rect.x + begin, rect.x + end) - rect.x;
+    },
+    [&](int y, int begin, int end) {
+      return find_last(rect.y + y, rect.x + begin, rect.x + end) - rect.x;
+    });
+}
+
+Rect get_used_rect(const Image& image, bool gray_levels, int threshold, const Rect& rect) {
+  if (empty(rect))
+    return get_used_rect(image, gray_levels, threshold, image.rect());
+  check_rect(image, rect);
+
+  const auto limit = get_threshold(gray_levels, threshold);
+  const auto& kernel = get_scan_kernel();
+  const auto image_rgba = image.view<RGBA>();
+  return scan_used_rect(rect,
+    [&](int y, int begin, int end) {
+      return begin + kernel.find_first(
+        image_rgba.values_at(rect.x + begin, rect.y + y), end - begin, limit);
+    },
+    [&](int y, int begin, int end) {
+      return begin + kernel.find_last(
+        image_rgba.values_at(rect.x + begin, rect.y + y), end - begin, limit);
+    });
+}
+
+} // namespace
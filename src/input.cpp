@@ -1,11 +1,99 @@
 
 #include "input.h"
 #include "InputParser.h"
+#include <condition_variable>
+#include <exception>
 #include <fstream>
 #include <iostream>
+#include <set>
 
 namespace spright {
 
+SourceCache source_cache;
+
+void SourceCache::set_memory_limit(size_t bytes) {
+  const auto lock = std::lock_guard(m_mutex);
+  m_memory_limit = bytes;
+  // idle buffers of transient images get a share of the limit
+  set_buffer_pool_limit(bytes ? bytes / 8 : default_buffer_pool_limit);
+}
+
+size_t SourceCache::memory_limit() const {
+  const auto lock = std::lock_guard(m_mutex);
+  return m_memory_limit;
+}
+
+size_t SourceCache::decoded_bytes() const {
+  const auto lock = std::lock_guard(m_mutex);
+  return m_decoded_bytes;
+}
+
+bool SourceCache::add(const ImageFile* file, size_t bytes) {
+  {
+    const auto lock = std::lock_guard(m_mutex);
+    if (!m_memory_limit)
+      return false;
+    if (std::find(m_files.begin(), m_files.end(), file) == m_files.end())
+      m_files.push_back(file);
+    m_decoded_bytes += bytes;
+  }
+  evict(file);
+  return true;
+}
+
+void SourceCache::remove(const ImageFile* file) {
+  const auto lock = std::lock_guard(m_mutex);
+  const auto it = std::find(m_files.begin(), m_files.end(), file);
+  if (it == m_files.end())
+    return;
+  m_decoded_bytes -= file->try_evict();
+  m_files.erase(it);
+}
+
+void SourceCache::evict(const ImageFile* except) {
+  const auto lock = std::lock_guard(m_mutex);
+  if (!m_memory_limit || m_decoded_bytes <= m_memory_limit)
+    return;
+
+  // snapshot, since files are concurrently used
+  auto files = std::vector<std::pair<uint64_t, const ImageFile*>>();
+  for (const auto* file : m_files)
+    files.emplace_back(file->last_use(), file);
+  std::sort(files.begin(), files.end());
+  for (const auto& [last_use, file] : files) {
+    if (file == except)
+      continue;
+    m_decoded_bytes -= file->try_evict();
+    if (m_decoded_bytes <= m_memory_limit)
+      break;
+  }
+}
+
+namespace {
+  // only sources, which are accessed before the output
+  bool needs_pixels(const Sprite& sprite) {
+    return (sprite.trim != Trim::none ||
+            !sprite.transforms.empty() ||
+            sprite.sheet->duplicates != Duplicates::keep);
+  }
+
+  template<typename F> // F(const ImageFile*)
+  void for_each_prefetched_source(const Sprite& sprite, F&& function) {
+    if (!sprite.source || !needs_pixels(sprite))
+      return;
+    function(sprite.source.get());
+    if (sprite.maps)
+      for (const auto& map : *sprite.maps)
+        if (map)
+          function(map.get());
+  }
+
+  size_t get_decoded_size(const ImageFile& source) {
+    return to_unsigned(source.width()) *
+      to_unsigned(source.height()) * sizeof(RGBA);
+  }
+} // namespace
+
 InputDefinition parse_definition(const Settings& settings) {
   auto parser = InputParser(settings);
 
@@ -34,6 +122,96 @@ InputDefinition parse_definition(const Settings& settings) {
   };
 }
 
+std::vector<span<Sprite>> get_source_waves(std::vector<Sprite>& sprites) {
+  const auto memory_limit = source_cache.memory_limit();
+  auto waves = std::vector<span<Sprite>>();
+  auto begin = size_t{ };
+  auto wave_bytes = size_t{ };
+  auto wave_sources = std::set<const ImageFile*>();
+  auto sprite_sources = std::vector<const ImageFile*>();
+  for (auto i = size_t{ }; i < sprites.size(); ++i) {
+    sprite_sources.clear();
+    for_each_prefetched_source(sprites[i], [&](const ImageFile* source) {
+      sprite_sources.push_back(source);
+    });
+    const auto get_added_bytes = [&]() {
+      auto bytes = size_t{ };
+      for (const auto* source : sprite_sources)
+        if (!wave_sources.count(source))
+          bytes += get_decoded_size(*source);
+      return bytes;
+    };
+    if (memory_limit && i > begin &&
+        wave_bytes + get_added_bytes() > memory_limit) {
+      waves.emplace_back(sprites.data() + begin, i - begin);
+      begin = i;
+      wave_bytes = 0;
+      wave_sources.clear();
+    }
+    wave_bytes += get_added_bytes();
+    wave_sources.insert(sprite_sources.begin(), sprite_sources.end());
+  }
+  if (begin < sprites.size())
+    waves.emplace_back(sprites.data() + begin, sprites.size() - begin);
+  return waves;
+}
+
+void decode_sources(span<const Sprite> sprites, size_t max_bytes_in_flight) {
+  auto sources = std::vector<const ImageFile*>();
+  auto added = std::set<const ImageFile*>();
+  for (const auto& sprite : sprites)
+    for_each_prefetched_source(sprite, [&](const ImageFile* source) {
+      if (added.insert(source).second)
+        sources.push_back(source);
+    });
+
+  // files are read one after another by this thread, while the ones
+  // already read are decoded by the scheduler. Reading waits while the
+  // decoded size of the files in flight would exceed the bound
+  struct State {
+    std::mutex mutex;
+    std::condition_variable released;
+    size_t bytes_in_flight{ };
+    size_t pending{ };
+    std::exception_ptr exception;
+  };
+  const auto state = std::make_shared<State>();
+  auto lock = std::unique_lock(state->mutex);
+  for (const auto* source : sources) {
+    const auto bytes = get_decoded_size(*source);
+    state->released.wait(lock, [&]() {
+      return (!state->bytes_in_flight ||
+              state->bytes_in_flight + bytes <= max_bytes_in_flight);
+    });
+    if (state->exception)
+      break;
+    state->bytes_in_flight += bytes;
+    ++state->pending;
+    lock.unlock();
+
+    scheduler.async([state, source, bytes,
+        file_data = read_image_file(source->path() / source->filename())]() noexcept {
+      auto exception = std::exception_ptr();
+      try {
+        source->decode(file_data);
+      }
+      catch (...) {
+        exception = std::current_exception();
+      }
+      const auto lock = std::lock_guard(state->mutex);
+      if (exception && !state->exception)
+        state->exception = exception;
+      state->bytes_in_flight -= bytes;
+      --state->pending;
+      state->released.notify_all();
+    });
+    lock.lock();
+  }
+  state->released.wait(lock, [&]() { return !state->pending; });
+  if (state->exception)
+    std::rethrow_exception(state->exception);
+}
+
 int get_max_slice_count(const Sheet& sheet) {
   auto max_count = std::numeric_limits<int>::max();
   for (const auto& output : sheet.outputs)
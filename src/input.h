@@ -4,6 +4,8 @@
 #include "settings.h"
 #include "FilenameSequence.h"
 #include <memory>
+#include <atomic>
+#include <mutex>
 
 namespace spright {
 
@@ -28,7 +30,7 @@ enum class Trim { none, rect, convex };
 
 enum class Alpha { keep, opaque, clear, bleed, premultiply, colorkey };
 
-enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep };
+enum class Pack { binpack, rows, columns, compact, origin, single, layers, keep, shelf, hierarchical, polygon, grid, shelf_columns };
 
 enum class Duplicates { keep, share, drop };
 
@@ -37,8 +39,49 @@ struct Extrude {
   WrapMode mode;
 };
 
+// decoded source images, least recently used are evicted when over limit
+class SourceCache {
+public:
+  void set_memory_limit(size_t bytes);
+  size_t memory_limit() const;
+  size_t decoded_bytes() const;
+  uint64_t next_use() { return ++m_use_counter; }
+  bool add(const ImageFile* file, size_t bytes);
+  void remove(const ImageFile* file);
+  void evict(const ImageFile* except = nullptr);
+
+private:
+  mutable std::mutex m_mutex;
+  std::atomic<uint64_t> m_use_counter{ };
+  size_t m_memory_limit{ };
+  size_t m_decoded_bytes{ };
+  std::vector<const ImageFile*> m_files;
+};
+
+extern SourceCache source_cache;
+
 class ImageFile {
 public:
+  // prevents image from being evicted, while it is accessed
+  class Pin {
+  public:
+    explicit Pin(const ImageFile* file) : m_file(file) {
+      const auto lock = std::lock_guard(m_file->m_mutex);
+      ++m_file->m_pins;
+    }
+    Pin(Pin&& rhs) noexcept : m_file(std::exchange(rhs.m_file, nullptr)) { }
+    Pin& operator=(Pin&&) = delete;
+    ~Pin() {
+      if (!m_file)
+        return;
+      const auto lock = std::lock_guard(m_file->m_mutex);
+      --m_file->m_pins;
+    }
+
+  private:
+    const ImageFile* m_file;
+  };
+
   ImageFile(Image image, std::filesystem::path path, std::filesystem::path filename) 
     : m_image(std::move(image)),
       m_path(std::move(path)),
@@ -50,16 +93,28 @@ public:
   ImageFile(std::filesystem::path path, std::filesystem::path filename, RGBA colorkey = { }) 
     : m_path(std::move(path)), 
       m_filename(std::move(filename)),
-      m_colorkey(colorkey) {
+      m_colorkey(colorkey),
+      m_evictable(true) {
     load_image_header(m_path / m_filename, &m_width, &m_height);
   }
 
+  ImageFile(const ImageFile&) = delete;
+  ImageFile& operator=(const ImageFile&) = delete;
+
+  ~ImageFile() {
+    if (m_cached)
+      source_cache.remove(this);
+  }
+
   const std::filesystem::path& path() const { return m_path; }
   const std::filesystem::path& filename() const { return m_filename; }
   int width() const { return m_width; }
   int height() const { return m_height; }
   Rect rect() const { return { 0, 0, width(), height() }; }
+  uint64_t last_use() const { return m_last_use; }
+  Pin pin() const { return Pin(this); }
 
+  // callers have to pin the file, while a memory limit is set
   Image& image() {    
     lazy_load_image();
     return m_image;
@@ -70,26 +125,64 @@ public:
     return m_image;
   }
 
+  // decodes the image from the already read file, unless it is loaded
+  void decode(const std::vector<std::byte>& file_data) const {
+    lazy_load_image(file_data);
+  }
+
+  // shared by all sprites cut from this source
+  const OccupancyMap& occupancy(bool gray_levels, int threshold) const {
+    const auto lock = std::lock_guard(m_occupancy_mutex);
+    for (const auto& map : m_occupancy_maps)
+      if (map->gray_levels() == gray_levels && map->threshold() == threshold)
+        return *map;
+    const auto pin = Pin(this);
+    return *m_occupancy_maps.emplace_back(
+      std::make_unique<OccupancyMap>(image(), gray_levels, threshold));
+  }
+
+  // returns the number of bytes freed
+  size_t try_evict() const {
+    const auto lock = std::unique_lock(m_mutex, std::try_to_lock);
+    if (!lock.owns_lock() || m_pins || !m_evictable || !m_image)
+      return 0;
+    const auto bytes = m_image.size_bytes();
+    m_image = Image();
+    return bytes;
+  }
+
 private:
-  void lazy_load_image() const {
-    const auto lock = std::lock_guard(m_mutex);
+  void lazy_load_image(const std::vector<std::byte>& file_data = { }) const {
+    auto lock = std::unique_lock(m_mutex);
+    m_last_use = source_cache.next_use();
     if (m_image)
       return;
 
-    m_image = load_image(m_path / m_filename);
+    m_image = load_image(m_path / m_filename, file_data);
     auto colorkey = m_colorkey;
     if (colorkey != RGBA{ }) {
       if (!colorkey.a)
         colorkey = guess_colorkey(m_image);
       replace_color(m_image, colorkey, RGBA{ });
     }
+    const auto bytes = m_image.size_bytes();
+    lock.unlock();
+
+    if (m_evictable && source_cache.add(this, bytes))
+      m_cached = true;
   }
 
   mutable std::mutex m_mutex;
   mutable Image m_image;
+  mutable int m_pins{ };
+  mutable std::atomic<uint64_t> m_last_use{ };
+  mutable std::atomic<bool> m_cached{ };
+  mutable std::mutex m_occupancy_mutex;
+  mutable std::vector<std::unique_ptr<const OccupancyMap>> m_occupancy_maps;
   std::filesystem::path m_path;
   std::filesystem::path m_filename;
   RGBA m_colorkey{ };
+  bool m_evictable{ };
   int m_width{ };
   int m_height{ };
 };
@@ -128,6 +221,7 @@ struct Output {
   RGBA alpha_color{ };
   std::vector<TransformPtr> transforms;
   bool debug{ };
+  Compression compression{ };
 
   // the scale after transformation, 0 when rotated
   SizeF scale{ };
@@ -150,6 +244,9 @@ struct Sheet {
   int shape_padding{ };
   Duplicates duplicates{ };
   Pack pack{ };
+  real pack_time_limit{ };
+  bool incremental{ };
+  real min_occupancy{ };
 };
 
 struct Sprite {
@@ -195,6 +292,8 @@ struct Sprite {
   bool rotated{ };
   std::vector<PointF> outline;
   int duplicate_of_index{ -1 };
+  // hash of trimmed source pixels, set for deduplication and layout
+  uint64_t hash{ };
 };
 
 struct Description {
@@ -210,6 +309,9 @@ struct InputDefinition {
 };
 
 InputDefinition parse_definition(const Settings& settings);
+std::vector<span<Sprite>> get_source_waves(std::vector<Sprite>& sprites);
+void decode_sources(span<const Sprite> sprites,
+  size_t max_bytes_in_flight = size_t{ 1 } << 30);
 int get_max_slice_count(const Sheet& sheet);
 
 } // namespace
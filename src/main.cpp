@@ -17,6 +17,9 @@ int main(int argc, const char* argv[]) try {
     return 1;
   }
 
+  source_cache.set_memory_limit(settings.memory_limit);
+  set_image_cache_path(settings.cache_path);
+
   using Clock = std::chrono::high_resolution_clock;
   auto time_points = std::vector<std::pair<Clock::time_point, const char*>>();
   time_points.emplace_back(Clock::now(), "begin");
@@ -29,13 +32,23 @@ int main(int argc, const char* argv[]) try {
   if (settings.mode != Mode::complete &&
       settings.mode != Mode::describe_input) {
 
-    transform_sprites(sprites);
-    time_points.emplace_back(Clock::now(), "transforming");
+    // sprites are processed in waves, whose sources fit in the memory limit
+    for (auto wave : get_source_waves(sprites)) {
+      decode_sources(wave);
+      time_points.emplace_back(Clock::now(), "decoding");
+
+      transform_sprites(wave);
+      time_points.emplace_back(Clock::now(), "transforming");
 
-    trim_sprites(sprites);
-    time_points.emplace_back(Clock::now(), "trimming");
+      trim_sprites(wave);
+      time_points.emplace_back(Clock::now(), "trimming");
+    }
 
-    slices = pack_sprites(sprites);
+    const auto layout_filename = get_layout_filename(settings);
+    slices = pack_sprites(sprites, (settings.mode != Mode::rebuild ?
+      load_layout(layout_filename) : Layout{ }));
+    if (settings.mode != Mode::describe)
+      save_layout(layout_filename, sprites, slices);
     textures = get_textures(settings, slices);
     evaluate_expressions(settings, sprites, textures, variables);
     time_points.emplace_back(Clock::now(), "packing");
@@ -73,6 +86,11 @@ int main(int argc, const char* argv[]) try {
         std::chrono::duration_cast<std::chrono::milliseconds>(
           time_points[i].first - time_points[i - 1].first).count() << "ms";
     std::cout << std::endl;
+
+    for (const auto& slice : slices)
+      if (slice.compact_iterations)
+        std::cout << "compacting slice " << slice.index << ": " <<
+          slice.compact_iterations << " iterations" << std::endl;
   }
   return (has_warnings() ? 2 : 0);
 }
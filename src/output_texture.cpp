@@ -3,6 +3,7 @@
 #include "globbing.h"
 #include "transforming.h"
 #include "debug.h"
+#include <numeric>
 
 namespace spright {
 
@@ -16,6 +17,40 @@ namespace {
     return nullptr;
   }
 
+  // keeps sources of slice from being evicted, while it is composed
+  std::vector<ImageFile::Pin> pin_sources(const Slice& slice, int map_index) {
+    auto pins = std::vector<ImageFile::Pin>();
+    pins.reserve(slice.sprites.size());
+    for (const auto& sprite : slice.sprites) {
+      if (map_index < 0)
+        pins.push_back(sprite.source->pin());
+      else if (sprite.maps && to_unsigned(map_index) < sprite.maps->size())
+        pins.push_back(sprite.maps->at(to_unsigned(map_index))->pin());
+    }
+    return pins;
+  }
+
+  // textures sharing sources are composed one after another,
+  // so they find the sources in the cache
+  std::vector<size_t> get_texture_order(const std::vector<Texture>& textures) {
+    auto source_indices = std::map<const ImageFile*, size_t>();
+    auto keys = std::vector<size_t>();
+    for (const auto& texture : textures) {
+      auto key = std::numeric_limits<size_t>::max();
+      for (const auto& sprite : texture.slice->sprites) {
+        const auto index = source_indices.emplace(
+          sprite.source.get(), source_indices.size()).first->second;
+        key = std::min(key, index);
+      }
+      keys.push_back(key);
+    }
+    auto order = std::vector<size_t>(textures.size());
+    std::iota(order.begin(), order.end(), size_t{ });
+    std::stable_sort(order.begin(), order.end(),
+      [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    return order;
+  }
+
   bool has_rect_outline(const Sprite& sprite) {
     const auto& v = sprite.outline;
     const auto [w, h] = sprite.trimmed_rect.size();
@@ -78,31 +113,16 @@ namespace {
 #endif
   }
 
-  void process_alpha(Image& target, const Output& output) {
-    switch (output.alpha) {
+  PixelFilter get_pixel_filter(Alpha alpha) {
+    switch (alpha) {
       case Alpha::keep:
-        break;
-
-      case Alpha::opaque:
-        make_opaque(target);
-        break;
-
-      case Alpha::clear:
-        clear_alpha(target, output.alpha_color);
-        break;
-
-      case Alpha::bleed:
-        bleed_alpha(target);
-        break;
-
-      case Alpha::premultiply:
-        premultiply_alpha(target);
-        break;
-
-      case Alpha::colorkey:
-        make_opaque(target, output.alpha_color);
-        break;
+      case Alpha::bleed: return PixelFilter::none;
+      case Alpha::opaque: return PixelFilter::make_opaque;
+      case Alpha::clear: return PixelFilter::clear_alpha;
+      case Alpha::premultiply: return PixelFilter::premultiply_alpha;
+      case Alpha::colorkey: return PixelFilter::colorkey;
     }
+    return PixelFilter::none;
   }
 
   bool is_map(const Texture& texture) {
@@ -118,8 +138,11 @@ namespace {
 
   void process_texture_image(const Texture& texture, Image& image) {
     const auto& output = *texture.output;
-    process_alpha(image, output);
-    image = transform_output(std::move(image), output.transforms);
+    // bleeding is not per pixel, the others are applied in a single pass
+    if (output.alpha == Alpha::bleed)
+      bleed_alpha(image);
+    image = transform_output(std::move(image), output.transforms,
+      get_pixel_filter(output.alpha), output.alpha_color);
   }
 
   bool output_image(const Texture& texture) {
@@ -139,7 +162,7 @@ namespace {
     if (texture.output->debug)
       draw_debug_info(image, *texture.slice, texture.output->scale);
 
-    save_image(image, texture.filename);
+    save_image(image, texture.filename, texture.output->compression);
     return true;
   }
 
@@ -179,6 +202,7 @@ namespace {
 } // namespace
 
 Image get_slice_image(const Slice& slice, int map_index) {
+  const auto pins = pin_sources(slice, map_index);
   auto target = Image(slice.width, slice.height, RGBA{ });
 
   auto copied_sprite = false;
@@ -191,6 +215,7 @@ Image get_slice_image(const Slice& slice, int map_index) {
 }
 
 Animation get_slice_animation(const Slice& slice, int map_index) {
+  const auto pins = pin_sources(slice, map_index);
   auto animation = Animation();
   for (const auto& sprite : slice.sprites) {
     auto& frame = animation.frames.emplace_back();
@@ -221,8 +246,10 @@ std::vector<Texture> get_textures(const Settings& settings,
 }
 
 void output_textures(std::vector<Texture>& textures) {
-  scheduler.for_each_parallel(textures,
-    [&](Texture& texture) {
+  const auto order = get_texture_order(textures);
+  scheduler.for_each_parallel(order,
+    [&](size_t index) {
+      auto& texture = textures[index];
       if (!output_texture(texture))
         texture.filename.clear();
     });
@@ -1,27 +1,20 @@
 
 #include "packing.h"
 #include "rect_pack/rect_pack.h"
+#include <chrono>
+#include <map>
+#include <mutex>
 
 namespace spright {
 
-void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
-    std::vector<Slice>& slices, bool fast) {
-  const auto& sheet = *sheet_ptr;
-
-  // pack rects
-  auto pack_sizes = std::vector<rect_pack::Size>();
-  pack_sizes.reserve(sprites.size());
-  for (const auto& sprite : sprites) {
-    auto size = sprite.size;
-    size.x += sheet.shape_padding;
-    size.y += sheet.shape_padding;
-    pack_sizes.push_back({ to_int(pack_sizes.size()), size.x, size.y });
-  }
+namespace {
+  using PackResult = std::vector<rect_pack::Sheet>;
 
-  const auto [max_width, max_height] = get_slice_max_size(sheet);
-  const auto pack_sheets = pack(
-    rect_pack::Settings{
-      (fast ? rect_pack::Method::Best_Skyline : rect_pack::Method::Best),
+  rect_pack::Settings get_pack_settings(const Sheet& sheet,
+      rect_pack::Method method) {
+    const auto [max_width, max_height] = get_slice_max_size(sheet);
+    return {
+      method,
       get_max_slice_count(sheet),
       sheet.power_of_two,
       sheet.square,
@@ -33,8 +26,138 @@ void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
       sheet.height,
       max_width,
       max_height,
-    },
-    std::move(pack_sizes));
+    };
+  }
+
+  std::vector<rect_pack::Size> get_pack_sizes(const Sheet& sheet,
+      SpriteSpan sprites) {
+    auto pack_sizes = std::vector<rect_pack::Size>();
+    pack_sizes.reserve(sprites.size());
+    for (const auto& sprite : sprites) {
+      auto size = sprite.size;
+      size.x += sheet.shape_padding;
+      size.y += sheet.shape_padding;
+      pack_sizes.push_back({ to_int(pack_sizes.size()), size.x, size.y });
+    }
+    return pack_sizes;
+  }
+
+  // more packed rects, then fewer sheets, then smaller area is better
+  auto get_pack_result_rank(const PackResult& result) {
+    auto rect_count = size_t{ };
+    auto area = int64_t{ };
+    for (const auto& sheet : result) {
+      rect_count += sheet.rects.size();
+      area += int64_t{ sheet.width } * sheet.height;
+    }
+    return std::make_tuple(-to_int(rect_count), result.size(), area);
+  }
+
+  PackResult race_pack_methods(const Sheet& sheet, SpriteSpan sprites,
+      rect_pack::Method default_method, bool fast) {
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() +
+      std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<real>(sheet.pack_time_limit));
+
+    // MaxRects does not scale to many sprites and can not be interrupted
+    auto methods = std::vector{
+      rect_pack::Method::Skyline_BottomLeft,
+      rect_pack::Method::Skyline_BestFit,
+    };
+    if (!fast)
+      methods.insert(methods.end(), {
+        rect_pack::Method::MaxRects_BestShortSideFit,
+        rect_pack::Method::MaxRects_BestLongSideFit,
+        rect_pack::Method::MaxRects_BestAreaFit,
+        rect_pack::Method::MaxRects_BottomLeftRule,
+        rect_pack::Method::MaxRects_ContactPointRule,
+      });
+
+    using SizeKey = int(*)(const rect_pack::Size&);
+    const auto orders = std::initializer_list<SizeKey>{
+      [](const rect_pack::Size& s) { return s.width * s.height; },
+      [](const rect_pack::Size& s) { return std::max(s.width, s.height); },
+      [](const rect_pack::Size& s) { return s.height; },
+      [](const rect_pack::Size& s) { return s.width; },
+      [](const rect_pack::Size& s) { return s.width + s.height; },
+    };
+
+    // the first candidate is the default method in input order,
+    // the cheaper Skyline candidates are started before MaxRects
+    struct Candidate {
+      rect_pack::Method method;
+      SizeKey order;
+      PackResult result;
+      bool finished;
+    };
+    auto candidates = std::vector<Candidate>();
+    candidates.push_back({ default_method, nullptr, { }, false });
+    for (auto method : methods)
+      for (auto order : orders)
+        candidates.push_back({ method, order, { }, false });
+
+    const auto pack_sizes = get_pack_sizes(sheet, sprites);
+    const auto pack_candidate = [&](Candidate& candidate) {
+      auto sizes = pack_sizes;
+      if (candidate.order)
+        std::stable_sort(sizes.begin(), sizes.end(),
+          [&](const rect_pack::Size& a, const rect_pack::Size& b) {
+            return (candidate.order(a) > candidate.order(b));
+          });
+      candidate.result = rect_pack::pack(
+        get_pack_settings(sheet, candidate.method), std::move(sizes));
+      candidate.finished = true;
+    };
+
+    // the default method always completes. Its duration is the estimate
+    // for the other methods, until one of them finished
+    const auto start = Clock::now();
+    pack_candidate(candidates.front());
+    const auto default_duration = Clock::now() - start;
+
+    // candidates are not interrupted, so they are only started,
+    // when the longest duration of their method fits in the remaining time
+    auto mutex = std::mutex();
+    auto durations = std::map<rect_pack::Method, Clock::duration>();
+    scheduler.for_each_parallel(candidates.size() - 1, [&](size_t index) {
+      auto& candidate = candidates[index + 1];
+      auto lock = std::unique_lock(mutex);
+      const auto it = durations.find(candidate.method);
+      const auto estimate = (it != durations.end() ? it->second : default_duration);
+      lock.unlock();
+      const auto candidate_start = Clock::now();
+      if (candidate_start + estimate > deadline)
+        return;
+
+      pack_candidate(candidate);
+
+      const auto duration = Clock::now() - candidate_start;
+      lock.lock();
+      auto& max_duration = durations.try_emplace(candidate.method, duration).first->second;
+      max_duration = std::max(max_duration, duration);
+    });
+
+    auto best = &candidates.front();
+    for (auto& candidate : candidates)
+      if (candidate.finished &&
+          get_pack_result_rank(candidate.result) < get_pack_result_rank(best->result))
+        best = &candidate;
+    return std::move(best->result);
+  }
+} // namespace
+
+void pack_binpack(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices, bool fast) {
+  const auto& sheet = *sheet_ptr;
+
+  // pack rects
+  const auto method = (fast ?
+    rect_pack::Method::Best_Skyline : rect_pack::Method::Best);
+  const auto pack_sheets = (sheet.pack_time_limit > 0 ?
+    race_pack_methods(sheet, sprites, method, fast) :
+    rect_pack::pack(get_pack_settings(sheet, method),
+      get_pack_sizes(sheet, sprites)));
 
   // update sprite rects
   auto slice_index = 0;
@@ -12,7 +12,27 @@ namespace {
   struct FreeBody { void operator()(cpBody* body) { cpBodyFree(body); } };
   using BodyPtr = std::unique_ptr<cpBody, FreeBody>;
 
-  void compact_sprites(const Slice& slice, int border_padding, int shape_padding) {
+  const auto max_iterations = 1000;
+  const auto max_phase_iterations = 100;
+  const auto max_unimproved_phases = 2;
+  const auto settled_iterations = 10;
+  const auto settled_velocity = 0.5;
+
+  real get_bounding_area(const Slice& slice, const std::vector<Point>& positions) {
+    auto x1 = 0;
+    auto y1 = 0;
+    for (auto i = 0u; i < positions.size(); ++i) {
+      const auto& sprite = slice.sprites[i];
+      const auto size = (sprite.rotated ?
+        Size{ sprite.size.y, sprite.size.x } : sprite.size);
+      x1 = std::max(x1, positions[i].x + size.x);
+      y1 = std::max(y1, positions[i].y + size.y);
+    }
+    return to_real(x1) * to_real(y1);
+  }
+
+  // returns number of simulation steps
+  int compact_sprites(const Slice& slice, int border_padding, int shape_padding) {
     auto space_ptr = SpacePtr(cpSpaceNew());
     const auto space = space_ptr.get();
 
@@ -51,22 +71,59 @@ namespace {
         to_int(outline.size()), outline.data(), cpTransformIdentity, padding)));
     }
 
-    // TODO: improve
-    for (auto i = 0; i < 1000; i++) {
-      cpSpaceSetGravity(space, cpVect{ 20.0 * ((i / 100) % 2 ? 1 : -1), -100 });
-      cpSpaceStep(space, 1.0 / 60);
+    auto best_positions = std::vector<Point>();
+    for (const auto& sprite : slice.sprites)
+      best_positions.push_back({ sprite.rect.x, sprite.rect.y });
+    auto best_area = get_bounding_area(slice, best_positions);
+    auto positions = best_positions;
+
+    // alternate horizontal gravity, until the bounding area no longer
+    // decreases in either direction or the iteration budget is exhausted
+    auto iterations = 0;
+    for (auto phase = 0, unimproved_phases = 0;
+         unimproved_phases < max_unimproved_phases &&
+         iterations < max_iterations; ++phase) {
+
+      cpSpaceSetGravity(space, cpVect{ 20.0 * (phase % 2 ? 1 : -1), -100 });
+      for (auto i = 0, settled = 0; i < max_phase_iterations &&
+           settled < settled_iterations && iterations < max_iterations; ++i) {
+        cpSpaceStep(space, 1.0 / 60);
+        ++iterations;
+
+        const auto moving = std::any_of(bodies.begin(), bodies.end(),
+          [&](const BodyPtr& body) {
+            return (cpvlengthsq(cpBodyGetVelocity(body.get())) >
+              settled_velocity * settled_velocity);
+          });
+        settled = (moving ? 0 : settled + 1);
+      }
+
+      for (auto i = 0u; i < bodies.size(); ++i) {
+        const auto position = cpBodyGetPosition(bodies[i].get());
+        positions[i] = { round_to_int(position.x), round_to_int(position.y) };
+      }
+      const auto area = get_bounding_area(slice, positions);
+      if (area < best_area) {
+        best_area = area;
+        best_positions = positions;
+        unimproved_phases = 0;
+      }
+      else {
+        ++unimproved_phases;
+      }
     }
 
+    // keep the densest placement, which might be the initial one
     auto i = 0u;
-    for (const auto& body : bodies) {
-      auto& sprite = slice.sprites[i++];
-      const auto position = cpBodyGetPosition(body.get());
-      sprite.rect.x = round_to_int(position.x);
-      sprite.rect.y = round_to_int(position.y);
+    for (auto& sprite : slice.sprites) {
+      sprite.rect.x = best_positions[i].x;
+      sprite.rect.y = best_positions[i].y;
+      ++i;
     }
 
     // destroy space before shapes
     space_ptr.reset();
+    return iterations;
   }
 } // namespace
 
@@ -76,7 +133,8 @@ void pack_compact(const SheetPtr& sheet, SpriteSpan sprites,
   pack_binpack(sheet, sprites, slices, fast);
   scheduler.for_each_parallel(slices, [&](Slice& slice) {
     recompute_slice_size(slice);
-    compact_sprites(slice, sheet->border_padding, sheet->shape_padding);
+    slice.compact_iterations = compact_sprites(slice,
+      sheet->border_padding, sheet->shape_padding);
   });
 }
 
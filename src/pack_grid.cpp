@@ -0,0 +1,81 @@
+
+#include "packing.h"
+#include <limits>
+
+namespace spright {
+
+namespace {
+  // finds the column count resulting in the smallest slice
+  int get_grid_columns(const Sheet& sheet, const Size& cell, int count,
+      int max_columns, int max_rows) {
+    auto best_columns = max_columns;
+    auto best_area = std::numeric_limits<int64_t>::max();
+    auto best_difference = std::numeric_limits<int>::max();
+    const auto min_columns = std::max((count + max_rows - 1) / max_rows, 1);
+    for (auto columns = min_columns; columns <= std::min(count, max_columns); ++columns) {
+      const auto rows = (count + columns - 1) / columns;
+      const auto [width, height] = get_slice_size(sheet,
+        sheet.border_padding + columns * cell.x - sheet.shape_padding,
+        sheet.border_padding + rows * cell.y - sheet.shape_padding);
+      const auto area = int64_t{ width } * height;
+      const auto difference = std::abs(width - height);
+      if (std::tie(area, difference) < std::tie(best_area, best_difference)) {
+        best_area = area;
+        best_difference = difference;
+        best_columns = columns;
+      }
+    }
+    return best_columns;
+  }
+} // namespace
+
+bool has_uniform_size(SpriteSpan sprites) {
+  return std::all_of(sprites.begin(), sprites.end(),
+    [&](const Sprite& sprite) { return sprite.size == sprites.front().size; });
+}
+
+void pack_grid(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices) {
+  const auto& sheet = *sheet_ptr;
+  auto cell = Size{ };
+  for (const auto& sprite : sprites) {
+    cell.x = std::max(cell.x, sprite.size.x + sheet.shape_padding);
+    cell.y = std::max(cell.y, sprite.size.y + sheet.shape_padding);
+  }
+
+  const auto [max_width, max_height] = get_slice_max_size(sheet);
+  const auto get_max_cells = [&](int max_size, int cell_size) {
+    const auto available = int64_t{ max_size } -
+      sheet.border_padding * 2 + sheet.shape_padding;
+    return static_cast<int>(std::clamp(available / std::max(cell_size, 1),
+      int64_t{ 0 }, static_cast<int64_t>(sprites.size())));
+  };
+  const auto max_columns = get_max_cells(max_width, cell.x);
+  const auto max_rows = get_max_cells(max_height, cell.y);
+  const auto max_slice_count = get_max_slice_count(sheet);
+  const auto slice_capacity = static_cast<int>(std::min(
+    int64_t{ max_columns } * max_rows, static_cast<int64_t>(sprites.size())));
+
+  for (auto& sprite : sprites)
+    sprite.slice_index = -1;
+
+  // fill slices in order, last slice gets the remaining sprites
+  auto slice_index = 0;
+  for (auto begin = size_t{ }; slice_capacity > 0 &&
+       begin < sprites.size() && slice_index < max_slice_count; ++slice_index) {
+    const auto count = std::min(to_int(sprites.size() - begin), slice_capacity);
+    const auto columns = get_grid_columns(sheet, cell, count,
+      max_columns, max_rows);
+    for (auto i = 0; i < count; ++i) {
+      auto& sprite = sprites[begin + to_unsigned(i)];
+      sprite.slice_index = slice_index;
+      sprite.rotated = false;
+      sprite.rect.x = sheet.border_padding + (i % columns) * cell.x;
+      sprite.rect.y = sheet.border_padding + (i / columns) * cell.y;
+    }
+    begin += to_unsigned(count);
+  }
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+}
+
+} // namespace
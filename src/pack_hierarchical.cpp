@@ -0,0 +1,165 @@
+
+#include "packing.h"
+#include "rect_pack/rect_pack.h"
+#include <numeric>
+#include <cmath>
+
+namespace spright {
+
+namespace {
+  const auto max_cluster_size = size_t{ 1000 };
+
+  struct Block {
+    std::vector<rect_pack::Rect> rects;
+    int width;
+    int height;
+  };
+
+  rect_pack::Size get_pack_size(const Sheet& sheet, const Sprite& sprite, int id) {
+    return { id, sprite.size.x + sheet.shape_padding,
+                 sprite.size.y + sheet.shape_padding };
+  }
+
+  // packs a cluster of similar sized sprites into one or more blocks
+  std::vector<Block> pack_cluster(const Sheet& sheet, SpriteSpan sprites,
+      const std::vector<size_t>& indices, int max_width, int max_height) {
+    auto pack_sizes = std::vector<rect_pack::Size>();
+    pack_sizes.reserve(indices.size());
+    auto area = real{ };
+    auto min_width = 0;
+    for (auto index : indices) {
+      const auto& size = pack_sizes.emplace_back(
+        get_pack_size(sheet, sprites[index], to_int(index)));
+      area += to_real(size.width) * to_real(size.height);
+      min_width = std::max(min_width, (sheet.allow_rotate ?
+        std::min(size.width, size.height) : size.width));
+    }
+
+    // prefer square blocks, which are easier to pack
+    auto settings = rect_pack::Settings{ };
+    settings.method = rect_pack::Method::Best;
+    settings.allow_rotate = sheet.allow_rotate;
+    settings.max_width = std::min(max_width, std::max(min_width,
+      floor_to_int(std::ceil(std::sqrt(area * 1.1)))));
+    settings.max_height = max_height;
+    auto pack_sheets = rect_pack::pack(settings, std::move(pack_sizes));
+
+    // block extents include the shape padding
+    auto blocks = std::vector<Block>();
+    for (auto& pack_sheet : pack_sheets) {
+      auto& block = blocks.emplace_back(Block{ std::move(pack_sheet.rects), 0, 0 });
+      for (const auto& rect : block.rects) {
+        const auto& size = sprites[to_unsigned(rect.id)].size;
+        const auto w = (rect.rotated ? size.y : size.x) + sheet.shape_padding;
+        const auto h = (rect.rotated ? size.x : size.y) + sheet.shape_padding;
+        block.width = std::max(block.width, rect.x + w);
+        block.height = std::max(block.height, rect.y + h);
+      }
+    }
+    return blocks;
+  }
+} // namespace
+
+void pack_hierarchical(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices) {
+  const auto& sheet = *sheet_ptr;
+  if (sprites.size() <= max_cluster_size)
+    return pack_binpack(sheet_ptr, sprites, slices, false);
+
+  // cluster sprites of similar size
+  auto order = std::vector<size_t>(sprites.size());
+  std::iota(order.begin(), order.end(), size_t{ });
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    const auto& size_a = sprites[a].size;
+    const auto& size_b = sprites[b].size;
+    return std::tie(size_b.y, size_b.x, a) < std::tie(size_a.y, size_a.x, b);
+  });
+  const auto cluster_count =
+    (sprites.size() + max_cluster_size - 1) / max_cluster_size;
+  auto clusters = std::vector<std::vector<size_t>>(cluster_count);
+  for (auto i = size_t{ }; i < order.size(); ++i)
+    clusters[i * cluster_count / order.size()].push_back(order[i]);
+
+  // pack clusters into blocks in parallel
+  const auto [max_width, max_height] = get_slice_max_size(sheet);
+  const auto max_block_width = max_width - sheet.border_padding * 2 + sheet.shape_padding;
+  const auto max_block_height = max_height - sheet.border_padding * 2 + sheet.shape_padding;
+  auto cluster_blocks = std::vector<std::vector<Block>>(cluster_count);
+  scheduler.for_each_parallel(cluster_count, [&](size_t i) {
+    cluster_blocks[i] = pack_cluster(sheet, sprites, clusters[i],
+      max_block_width, max_block_height);
+  });
+  auto blocks = std::vector<Block>();
+  for (auto& cluster : cluster_blocks)
+    std::move(cluster.begin(), cluster.end(), std::back_inserter(blocks));
+
+  // pack blocks into slices
+  auto block_sizes = std::vector<rect_pack::Size>();
+  for (const auto& block : blocks)
+    block_sizes.push_back({ to_int(block_sizes.size()), block.width, block.height });
+  const auto pack_sheets = rect_pack::pack(
+    rect_pack::Settings{
+      rect_pack::Method::Best,
+      get_max_slice_count(sheet),
+      sheet.power_of_two,
+      sheet.square,
+      false,
+      sheet.divisible_width,
+      sheet.border_padding,
+      sheet.shape_padding,
+      sheet.width,
+      sheet.height,
+      max_width,
+      max_height,
+    },
+    std::move(block_sizes));
+
+  // update sprite rects
+  for (auto& sprite : sprites)
+    sprite.slice_index = -1;
+  auto slice_index = 0;
+  for (const auto& pack_sheet : pack_sheets) {
+    for (const auto& pack_rect : pack_sheet.rects)
+      for (const auto& rect : blocks[to_unsigned(pack_rect.id)].rects) {
+        auto& sprite = sprites[to_unsigned(rect.id)];
+        sprite.rotated = rect.rotated;
+        sprite.slice_index = slice_index;
+        sprite.rect.x = pack_rect.x + rect.x;
+        sprite.rect.y = pack_rect.y + rect.y;
+      }
+    ++slice_index;
+  }
+  const auto first_slice = slices.size();
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+
+  // close the seams between blocks and the gaps at their ragged edges
+  scheduler.for_each_parallel(slices.size() - first_slice, [&](size_t i) {
+    slide_sprites_up_left(slices[first_slice + i]);
+  });
+
+  // refine last slice, where the seams between blocks waste most space
+  if (slices.size() > 1 && slices.back().sprites.size() <= max_cluster_size) {
+    auto& last_slice = slices.back();
+    recompute_slice_size(last_slice);
+    const auto previous_sprites = std::vector<Sprite>(
+      last_slice.sprites.begin(), last_slice.sprites.end());
+
+    auto refined_slices = std::vector<Slice>();
+    pack_binpack(sheet_ptr, last_slice.sprites, refined_slices, false);
+    if (refined_slices.size() == 1 &&
+        refined_slices[0].sprites.size() == previous_sprites.size()) {
+      auto& refined_slice = refined_slices[0];
+      recompute_slice_size(refined_slice);
+      if (refined_slice.width * refined_slice.height <=
+          last_slice.width * last_slice.height) {
+        for (auto& sprite : refined_slice.sprites)
+          sprite.slice_index = last_slice.sheet_index;
+        return;
+      }
+    }
+    std::copy(previous_sprites.begin(), previous_sprites.end(),
+      last_slice.sprites.begin());
+  }
+}
+
+} // namespace
@@ -0,0 +1,321 @@
+
+#include "packing.h"
+#include "nlohmann/json.hpp"
+#include <unordered_map>
+
+namespace spright {
+
+namespace {
+  struct Position {
+    int x;
+    int y;
+    int64_t bounds_area;
+
+    friend bool operator<(const Position& a, const Position& b) {
+      return std::tie(a.bounds_area, a.y, a.x) <
+             std::tie(b.bounds_area, b.y, b.x);
+    }
+  };
+
+  // maximal free rectangles of a slice, which are split by occupied rects
+  class FreeSpace {
+  public:
+    explicit FreeSpace(const Rect& bounds) : m_free{ bounds } { }
+
+    bool empty() const { return !m_occupied; }
+
+    void occupy(const Rect& rect) {
+      ++m_occupied;
+      m_used.x = std::max(m_used.x, rect.x1());
+      m_used.y = std::max(m_used.y, rect.y1());
+      auto split = std::vector<Rect>();
+      for (auto i = size_t{ }; i < m_free.size(); ) {
+        const auto free = m_free[i];
+        if (!overlapping(free, rect)) {
+          ++i;
+          continue;
+        }
+        if (rect.x > free.x)
+          split.push_back({ free.x, free.y, rect.x - free.x, free.h });
+        if (rect.x1() < free.x1())
+          split.push_back({ rect.x1(), free.y, free.x1() - rect.x1(), free.h });
+        if (rect.y > free.y)
+          split.push_back({ free.x, free.y, free.w, rect.y - free.y });
+        if (rect.y1() < free.y1())
+          split.push_back({ free.x, rect.y1(), free.w, free.y1() - rect.y1() });
+        m_free[i] = m_free.back();
+        m_free.pop_back();
+      }
+
+      // rects which were not split are still maximal,
+      // only keep split rects not contained in another one
+      const auto unsplit_count = m_free.size();
+      for (auto i = size_t{ }; i < split.size(); ++i) {
+        const auto contained = [&](size_t j) {
+          return (containing(split[j], split[i]) &&
+            (split[j] != split[i] || j < i));
+        };
+        auto maximal = std::none_of(m_free.begin(),
+          m_free.begin() + static_cast<std::ptrdiff_t>(unsplit_count),
+          [&](const Rect& free) { return containing(free, split[i]); });
+        for (auto j = size_t{ }; maximal && j < split.size(); ++j)
+          if (j != i && contained(j))
+            maximal = false;
+        if (maximal)
+          m_free.push_back(split[i]);
+      }
+    }
+
+    // position at the corner of a maximal free rect, which least grows
+    // the used bounds, then the top-most, left-most one
+    std::optional<Position> find_position(const Size& size) const {
+      auto best = std::optional<Position>();
+      for (const auto& free : m_free)
+        if (free.w >= size.x && free.h >= size.y) {
+          const auto position = Position{ free.x, free.y,
+            int64_t{ std::max(m_used.x, free.x + size.x) } *
+              std::max(m_used.y, free.y + size.y) };
+          if (!best || position < *best)
+            best = position;
+        }
+      return best;
+    }
+
+  private:
+    std::vector<Rect> m_free;
+    Size m_used{ };
+    int m_occupied{ };
+  };
+
+  double get_occupancy(const std::vector<Slice>& slices) {
+    auto used = 0.0;
+    auto total = 0.0;
+    for (const auto& slice : slices) {
+      for (const auto& sprite : slice.sprites)
+        used += sprite.size.x * sprite.size.y;
+      total += slice.width * slice.height;
+    }
+    return (total > 0 ? used / total : 0.0);
+  }
+} // namespace
+
+std::string get_layout_key(const Sprite& sprite) {
+  // source position distinguishes sprites without unique id
+  return sprite.id + '\n' + path_to_utf8(sprite.source->filename()) + '\n' +
+    std::to_string(sprite.source_rect.x) + ' ' + std::to_string(sprite.source_rect.y);
+}
+
+bool pack_incremental(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices, const SheetLayout& previous_layout) {
+  const auto& sheet = *sheet_ptr;
+  if (previous_layout.border_padding != sheet.border_padding ||
+      previous_layout.shape_padding != sheet.shape_padding)
+    return false;
+
+  struct Placement {
+    int slice_index;
+    Rect rect;
+    bool rotated;
+  };
+  auto initial_placements = std::vector<Placement>();
+  for (const auto& sprite : sprites)
+    initial_placements.push_back({ sprite.slice_index, sprite.rect, sprite.rotated });
+
+  const auto restore_initial_placements = [&]() {
+    std::sort(sprites.begin(), sprites.end(),
+      [](const Sprite& a, const Sprite& b) { return (a.index < b.index); });
+    for (auto i = size_t{ }; i < sprites.size(); ++i) {
+      sprites[i].slice_index = initial_placements[i].slice_index;
+      sprites[i].rect = initial_placements[i].rect;
+      sprites[i].rotated = initial_placements[i].rotated;
+    }
+    return false;
+  };
+
+  update_sprite_hashes(sprites);
+
+  auto previous_by_key = std::unordered_multimap<std::string_view, const LayoutSprite*>();
+  for (const auto& previous : previous_layout.sprites)
+    previous_by_key.emplace(previous.key, &previous);
+
+  const auto [max_width, max_height] = get_slice_max_size(sheet);
+  const auto max_slice_count = get_max_slice_count(sheet);
+  const auto max_x = max_width - sheet.border_padding + sheet.shape_padding;
+  const auto max_y = max_height - sheet.border_padding + sheet.shape_padding;
+  const auto get_padded_size = [&](const Sprite& sprite, bool rotated) {
+    auto size = sprite.size;
+    if (rotated)
+      std::swap(size.x, size.y);
+    size.x += sheet.shape_padding;
+    size.y += sheet.shape_padding;
+    return size;
+  };
+
+  // keep unchanged sprites at their previous position
+  auto changed_sprites = std::vector<Sprite*>();
+  auto kept_slice_indices = std::map<int, int>();
+  for (auto& sprite : sprites) {
+    const auto [begin, end] = previous_by_key.equal_range(get_layout_key(sprite));
+    const auto it = std::find_if(begin, end, [&](const auto& kv) {
+      const auto& previous = *kv.second;
+      const auto size = get_padded_size(sprite, previous.rotated);
+      return (previous.hash == sprite.hash &&
+              previous.size == sprite.size &&
+              (!previous.rotated || sheet.allow_rotate) &&
+              previous.position.x + size.x <= max_x &&
+              previous.position.y + size.y <= max_y);
+    });
+    if (it == end) {
+      changed_sprites.push_back(&sprite);
+      continue;
+    }
+    const auto& previous = *it->second;
+    sprite.slice_index = previous.slice_index;
+    sprite.rect.x = previous.position.x;
+    sprite.rect.y = previous.position.y;
+    sprite.rotated = previous.rotated;
+    kept_slice_indices[previous.slice_index] = { };
+    previous_by_key.erase(it);
+  }
+
+  // repack from scratch when there is nothing to keep
+  if (changed_sprites.size() == sprites.size() ||
+      to_int(kept_slice_indices.size()) > max_slice_count)
+    return restore_initial_placements();
+
+  // close gaps left by slices, which no longer contain sprites
+  auto slice_count = 0;
+  for (auto& [previous_index, index] : kept_slice_indices)
+    index = slice_count++;
+
+  const auto bounds = Rect{ sheet.border_padding, sheet.border_padding,
+    max_x - sheet.border_padding, max_y - sheet.border_padding };
+  auto free_spaces = std::vector<FreeSpace>(to_unsigned(slice_count),
+    FreeSpace(bounds));
+  for (auto& sprite : sprites)
+    if (sprite.slice_index >= 0) {
+      sprite.slice_index = kept_slice_indices[sprite.slice_index];
+      const auto size = get_padded_size(sprite, sprite.rotated);
+      free_spaces[to_unsigned(sprite.slice_index)].occupy({
+        sprite.rect.x, sprite.rect.y, size.x, size.y });
+    }
+
+  // place changed sprites into the free space, biggest first
+  std::stable_sort(changed_sprites.begin(), changed_sprites.end(),
+    [](const Sprite* a, const Sprite* b) {
+      return (a->size.x * a->size.y > b->size.x * b->size.y);
+    });
+  for (auto* sprite : changed_sprites) {
+    for (auto slice_index = 0; ; ++slice_index) {
+      if (slice_index == slice_count) {
+        if (slice_count == max_slice_count)
+          return restore_initial_placements();
+        free_spaces.emplace_back(bounds);
+        ++slice_count;
+      }
+      auto& free_space = free_spaces[to_unsigned(slice_index)];
+      auto position = free_space.find_position(
+        get_padded_size(*sprite, false));
+      auto rotated = false;
+      if (sheet.allow_rotate) {
+        const auto rotated_position = free_space.find_position(
+          get_padded_size(*sprite, true));
+        if (rotated_position && (!position || *rotated_position < *position)) {
+          position = rotated_position;
+          rotated = true;
+        }
+      }
+      if (!position) {
+        // sprite does not even fit on empty slice
+        if (free_space.empty())
+          return restore_initial_placements();
+        continue;
+      }
+      const auto size = get_padded_size(*sprite, rotated);
+      free_space.occupy({ position->x, position->y, size.x, size.y });
+      sprite->slice_index = slice_index;
+      sprite->rect.x = position->x;
+      sprite->rect.y = position->y;
+      sprite->rotated = rotated;
+      break;
+    }
+  }
+
+  // repack from scratch when too much space is wasted
+  auto sheet_slices = std::vector<Slice>();
+  create_slices_from_indices(sheet_ptr, sprites, sheet_slices);
+  for (auto& slice : sheet_slices)
+    recompute_slice_size(slice);
+  if (get_occupancy(sheet_slices) < sheet.min_occupancy)
+    return restore_initial_placements();
+
+  std::move(sheet_slices.begin(), sheet_slices.end(),
+    std::back_inserter(slices));
+  return true;
+}
+
+Layout load_layout(const std::filesystem::path& filename) try {
+  auto error = std::error_code{ };
+  if (!std::filesystem::exists(filename, error))
+    return { };
+
+  auto layout = Layout();
+  const auto json = nlohmann::json::parse(read_textfile(filename));
+  for (const auto& [sheet_id, json_sheet] : json.at("sheets").items()) {
+    auto& sheet_layout = layout[sheet_id];
+    sheet_layout.border_padding = json_sheet.at("borderPadding");
+    sheet_layout.shape_padding = json_sheet.at("shapePadding");
+    for (const auto& json_sprite : json_sheet.at("sprites")) {
+      auto& sprite = sheet_layout.sprites.emplace_back();
+      sprite.key = json_sprite.at("key");
+      sprite.hash = json_sprite.at("hash");
+      sprite.size = { json_sprite.at("w"), json_sprite.at("h") };
+      sprite.slice_index = json_sprite.at("sliceIndex");
+      sprite.position = { json_sprite.at("x"), json_sprite.at("y") };
+      sprite.rotated = json_sprite.at("rotated");
+    }
+  }
+  return layout;
+}
+catch (const std::exception&) {
+  // simply pack from scratch
+  return { };
+}
+
+void save_layout(const std::filesystem::path& filename,
+    const std::vector<Sprite>& sprites, const std::vector<Slice>& slices) {
+  auto layout_sprites = std::vector<const Sprite*>();
+  for (const auto& sprite : sprites)
+    if (sprite.sheet && sprite.sheet->incremental &&
+        sprite.slice_index >= 0 && sprite.duplicate_of_index < 0)
+      layout_sprites.push_back(&sprite);
+  if (layout_sprites.empty())
+    return;
+
+  auto json = nlohmann::json::object();
+  auto& json_sheets = json["sheets"];
+  json_sheets = nlohmann::json::object();
+  for (const auto* layout_sprite : layout_sprites) {
+    const auto& sprite = *layout_sprite;
+    const auto& sheet = *sprite.sheet;
+    auto& json_sheet = json_sheets[sheet.id];
+    if (json_sheet.is_null()) {
+      json_sheet["borderPadding"] = sheet.border_padding;
+      json_sheet["shapePadding"] = sheet.shape_padding;
+      json_sheet["sprites"] = nlohmann::json::array();
+    }
+    auto& json_sprite = json_sheet["sprites"].emplace_back();
+    json_sprite["key"] = get_layout_key(sprite);
+    json_sprite["hash"] = sprite.hash;
+    json_sprite["w"] = sprite.size.x;
+    json_sprite["h"] = sprite.size.y;
+    json_sprite["sliceIndex"] = slices.at(
+      to_unsigned(sprite.slice_index)).sheet_index;
+    json_sprite["x"] = sprite.rect.x - sprite.pack_margin.x0;
+    json_sprite["y"] = sprite.rect.y - sprite.pack_margin.y0;
+    json_sprite["rotated"] = sprite.rotated;
+  }
+  update_textfile(filename, json.dump(1, '\t'));
+}
+
+} // namespace
@@ -0,0 +1,360 @@
+
+#include "packing.h"
+#include <cmath>
+
+namespace spright {
+
+namespace {
+  // horizontal extent of a sprite in a row, empty when begin >= end
+  struct Span {
+    int begin;
+    int end;
+  };
+
+  struct Profile {
+    Size size;
+    // spans of rows, which are tested for overlaps
+    std::vector<Span> spans;
+    // range of non-empty rows and narrowest span in it
+    int first_row;
+    int last_row;
+    int min_span;
+    // spans of rows expanded by shape padding, which are marked as occupied
+    int padded_offset;
+    std::vector<Span> padded_spans;
+  };
+
+  class Occupancy {
+  public:
+    explicit Occupancy(int width)
+      : m_width(width),
+        m_words_per_row(to_unsigned(width + 63) / 64) {
+    }
+
+    int height() const { return to_int(m_rows.size()); }
+
+    // longest run of free columns in row
+    int max_free_run(int row) const {
+      return (row >= 0 && row < height() ? m_max_free_run[to_unsigned(row)] : m_width);
+    }
+
+    // returns last occupied column in [begin, end) or -1
+    int find_last(int row, int begin, int end) const {
+      begin = std::max(begin, 0);
+      end = std::min(end, m_width);
+      if (row < 0 || row >= height() || begin >= end)
+        return -1;
+      const auto& words = m_rows[to_unsigned(row)];
+      if (words.empty())
+        return -1;
+      for (auto x = end - 1; x >= begin; ) {
+        const auto word = words[to_unsigned(x / 64)];
+        const auto first = std::max(begin, x / 64 * 64);
+        auto bits = word & mask(first % 64, x % 64 + 1);
+        if (bits)
+          return x / 64 * 64 + 63 - count_leading_zeros(bits);
+        x = first - 1;
+      }
+      return -1;
+    }
+
+    void mark(int row, int begin, int end) {
+      begin = std::max(begin, 0);
+      end = std::min(end, m_width);
+      if (row < 0 || begin >= end)
+        return;
+      if (row >= height()) {
+        m_rows.resize(to_unsigned(row + 1));
+        m_max_free_run.resize(to_unsigned(row + 1), m_width);
+      }
+      auto& words = m_rows[to_unsigned(row)];
+      if (words.empty())
+        words.resize(m_words_per_row);
+      for (auto x = begin; x < end; ) {
+        const auto last = std::min(end, x / 64 * 64 + 64);
+        words[to_unsigned(x / 64)] |= mask(x % 64, (last - 1) % 64 + 1);
+        x = last;
+      }
+      update_max_free_run(row);
+    }
+
+  private:
+    void update_max_free_run(int row) {
+      const auto& words = m_rows[to_unsigned(row)];
+      auto max_run = 0;
+      auto run = 0;
+      for (auto x = 0; x < m_width; ) {
+        const auto word = words[to_unsigned(x / 64)];
+        if (!word && x % 64 == 0 && x + 64 <= m_width) {
+          run += 64;
+          max_run = std::max(max_run, run);
+          x += 64;
+          continue;
+        }
+        run = ((word >> (x % 64)) & 1 ? 0 : run + 1);
+        max_run = std::max(max_run, run);
+        ++x;
+      }
+      m_max_free_run[to_unsigned(row)] = max_run;
+    }
+
+    static uint64_t mask(int begin, int end) {
+      const auto upper = (end == 64 ? ~uint64_t{ } : (uint64_t{ 1 } << end) - 1);
+      return upper & ~((uint64_t{ 1 } << begin) - 1);
+    }
+
+    static int count_leading_zeros(uint64_t value) {
+      auto count = 0;
+      for (auto bit = uint64_t{ 1 } << 63; !(value & bit); bit >>= 1)
+        ++count;
+      return count;
+    }
+
+    int m_width;
+    size_t m_words_per_row;
+    std::vector<std::vector<uint64_t>> m_rows;
+    std::vector<int> m_max_free_run;
+  };
+
+  // conservatively rasterizes a convex polygon to one span per row
+  std::vector<Span> rasterize_convex(const std::vector<PointF>& polygon,
+      int width, int height) {
+    auto spans = std::vector<Span>(to_unsigned(height), Span{ width, 0 });
+    const auto extend = [&](int row, real x) {
+      if (row < 0 || row >= height)
+        return;
+      auto& span = spans[to_unsigned(row)];
+      span.begin = std::min(span.begin, std::max(floor_to_int(std::floor(x)), 0));
+      span.end = std::max(span.end, std::min(floor_to_int(std::ceil(x)), width));
+    };
+    for (auto i = 0u; i < polygon.size(); ++i) {
+      const auto& p = polygon[i];
+      const auto& q = polygon[(i + 1) % polygon.size()];
+      const auto y_min = std::min(p.y, q.y);
+      const auto y_max = std::max(p.y, q.y);
+      const auto row_begin = floor_to_int(std::floor(std::max(y_min, 0.0)));
+      const auto row_end = floor_to_int(std::ceil(std::min(y_max, to_real(height))));
+      for (auto row = row_begin; row <= std::min(row_end, height - 1); ++row) {
+        // clip edge to row and extend span by both end points
+        const auto y0 = std::clamp(to_real(row), y_min, y_max);
+        const auto y1 = std::clamp(to_real(row + 1), y_min, y_max);
+        if (p.y == q.y) {
+          extend(row, p.x);
+          extend(row, q.x);
+          continue;
+        }
+        extend(row, p.x + (q.x - p.x) * (y0 - p.y) / (q.y - p.y));
+        extend(row, p.x + (q.x - p.x) * (y1 - p.y) / (q.y - p.y));
+      }
+    }
+    return spans;
+  }
+
+  Profile get_profile(const Sprite& sprite, bool rotated, int shape_padding) {
+    auto profile = Profile{ };
+    profile.size = (rotated ? Size{ sprite.size.y, sprite.size.x } : sprite.size);
+    const auto [width, height] = profile.size;
+
+    // extruded borders and sizes without outline occupy the whole rect
+    const auto& trimmed = sprite.trimmed_source_rect;
+    auto content = std::vector<Span>(to_unsigned(height), Span{ 0, width });
+    if (!sprite.extrude.count && !sprite.outline.empty()) {
+      auto polygon = sprite.outline;
+      auto offset = Point{ sprite.align.x, sprite.align.y };
+      auto content_size = trimmed.size();
+      if (rotated) {
+        for (auto& vertex : polygon)
+          vertex = rotate_cw(vertex, trimmed.h);
+        offset = { sprite.size.y - trimmed.h - sprite.align.y, sprite.align.x };
+        std::swap(content_size.x, content_size.y);
+      }
+      const auto spans = rasterize_convex(polygon, content_size.x, content_size.y);
+      for (auto& span : content)
+        span = { width, 0 };
+      for (auto i = 0; i < content_size.y; ++i) {
+        const auto row = offset.y + i;
+        const auto& span = spans[to_unsigned(i)];
+        if (row >= 0 && row < height && span.begin < span.end)
+          content[to_unsigned(row)] = {
+            std::max(offset.x + span.begin, 0),
+            std::min(offset.x + span.end, width) };
+      }
+    }
+
+    // expand spans by shape padding in all directions
+    profile.padded_offset = -shape_padding;
+    profile.padded_spans.resize(to_unsigned(height + shape_padding * 2),
+      Span{ std::numeric_limits<int>::max(), std::numeric_limits<int>::min() });
+    for (auto i = 0; i < height; ++i) {
+      const auto& span = content[to_unsigned(i)];
+      if (span.begin >= span.end)
+        continue;
+      for (auto j = i; j <= i + shape_padding * 2; ++j) {
+        auto& padded = profile.padded_spans[to_unsigned(j)];
+        padded.begin = std::min(padded.begin, span.begin - shape_padding);
+        padded.end = std::max(padded.end, span.end + shape_padding);
+      }
+    }
+    profile.first_row = height;
+    profile.last_row = -1;
+    profile.min_span = width;
+    for (auto i = 0; i < height; ++i) {
+      const auto& span = content[to_unsigned(i)];
+      if (span.begin < span.end) {
+        profile.first_row = std::min(profile.first_row, i);
+        profile.last_row = i;
+        profile.min_span = std::min(profile.min_span, span.end - span.begin);
+      }
+    }
+    profile.spans = std::move(content);
+    return profile;
+  }
+
+  // finds top-most, left-most position
+  std::optional<Point> find_position(const Occupancy& occupancy,
+      const Profile& profile, int border_padding, int max_x, int max_y) {
+    const auto [width, height] = profile.size;
+    const auto last_y = std::min(max_y - height,
+      std::max(occupancy.height(), border_padding));
+    for (auto y = border_padding; y <= last_y; ++y) {
+      // skip rows, which do not have enough free space for any span
+      auto full_row = -1;
+      auto fits = true;
+      for (auto i = profile.last_row; i >= profile.first_row && full_row < 0; --i) {
+        const auto free_run = occupancy.max_free_run(y + i);
+        const auto& span = profile.spans[to_unsigned(i)];
+        if (free_run < profile.min_span)
+          full_row = y + i;
+        else if (free_run < span.end - span.begin)
+          fits = false;
+      }
+      if (full_row >= 0) {
+        y = full_row - profile.first_row;
+        continue;
+      }
+      if (!fits)
+        continue;
+
+      auto x = border_padding;
+      for (auto i = 0; i < height && x + width <= max_x; ++i) {
+        const auto& span = profile.spans[to_unsigned(i)];
+        if (span.begin >= span.end)
+          continue;
+        const auto last = occupancy.find_last(y + i,
+          x + span.begin, x + span.end);
+        if (last >= 0) {
+          // move right of occupied column and check again
+          x = last + 1 - span.begin;
+          i = -1;
+        }
+      }
+      if (x + width <= max_x)
+        return Point{ x, y };
+    }
+    return std::nullopt;
+  }
+
+  void mark_occupied(Occupancy& occupancy, const Profile& profile,
+      const Point& position) {
+    for (auto i = 0u; i < profile.padded_spans.size(); ++i) {
+      const auto& span = profile.padded_spans[i];
+      occupancy.mark(position.y + profile.padded_offset + to_int(i),
+        position.x + span.begin, position.x + span.end);
+    }
+  }
+
+  int get_polygon_sheet_width(const Sheet& sheet, SpriteSpan sprites,
+      int max_width) {
+    if (sheet.width)
+      return max_width;
+
+    // aim for a square sheet, sprites will overlap their bounding boxes
+    auto area = real{ };
+    auto width = 0;
+    for (const auto& sprite : sprites) {
+      area += to_real(sprite.size.x + sheet.shape_padding) *
+              to_real(sprite.size.y + sheet.shape_padding);
+      width = std::max(width, (sheet.allow_rotate ?
+        std::min(sprite.size.x, sprite.size.y) : sprite.size.x));
+    }
+    return std::min(max_width, std::max(width + sheet.border_padding * 2,
+      floor_to_int(std::ceil(std::sqrt(area * 0.8))) + sheet.border_padding * 2));
+  }
+} // namespace
+
+void pack_polygon(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices) {
+  const auto& sheet = *sheet_ptr;
+  const auto [max_width, max_height] = get_slice_max_size(sheet);
+  const auto max_x = get_polygon_sheet_width(sheet, sprites, max_width) -
+    sheet.border_padding;
+  const auto max_y = (max_height < std::numeric_limits<int>::max() ?
+    max_height - sheet.border_padding : std::numeric_limits<int>::max() / 2);
+  const auto max_slice_count = get_max_slice_count(sheet);
+
+  // rasterize outlines in parallel
+  struct Item {
+    Sprite* sprite;
+    Profile profile;
+    std::optional<Profile> rotated_profile;
+  };
+  auto items = std::vector<Item>(sprites.size());
+  scheduler.for_each_parallel(sprites.size(), [&](size_t i) {
+    auto& item = items[i];
+    item.sprite = &sprites[i];
+    item.profile = get_profile(sprites[i], false, sheet.shape_padding);
+    if (sheet.allow_rotate)
+      item.rotated_profile = get_profile(sprites[i], true, sheet.shape_padding);
+  });
+
+  // place biggest first
+  std::stable_sort(items.begin(), items.end(),
+    [](const Item& a, const Item& b) {
+      return (a.sprite->size.x * a.sprite->size.y >
+              b.sprite->size.x * b.sprite->size.y);
+    });
+
+  auto occupancies = std::vector<Occupancy>();
+  for (auto& item : items) {
+    auto& sprite = *item.sprite;
+    sprite.slice_index = -1;
+    sprite.rotated = false;
+    for (auto slice_index = 0; ; ++slice_index) {
+      if (slice_index == to_int(occupancies.size())) {
+        if (slice_index == max_slice_count)
+          break;
+        occupancies.emplace_back(max_x + sheet.border_padding);
+      }
+      auto& occupancy = occupancies[to_unsigned(slice_index)];
+      auto position = find_position(occupancy, item.profile,
+        sheet.border_padding, max_x, max_y);
+      auto rotated = false;
+      if (item.rotated_profile) {
+        const auto rotated_position = find_position(occupancy,
+          *item.rotated_profile, sheet.border_padding, max_x, max_y);
+        if (rotated_position && (!position ||
+              std::tie(rotated_position->y, rotated_position->x) <
+              std::tie(position->y, position->x))) {
+          position = rotated_position;
+          rotated = true;
+        }
+      }
+      if (!position) {
+        // sprite does not even fit on empty slice
+        if (!occupancy.height())
+          break;
+        continue;
+      }
+      mark_occupied(occupancy, (rotated ? *item.rotated_profile : item.profile),
+        *position);
+      sprite.slice_index = slice_index;
+      sprite.rotated = rotated;
+      sprite.rect.x = position->x;
+      sprite.rect.y = position->y;
+      break;
+    }
+  }
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+}
+
+} // namespace
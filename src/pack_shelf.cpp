@@ -0,0 +1,157 @@
+
+#include "packing.h"
+#include <cmath>
+
+namespace spright {
+
+namespace {
+  // finds the first shelf with enough remaining space in O(log n)
+  class ShelfIndex {
+  public:
+    int find_first(int min_space) const {
+      if (m_tree.empty() || m_tree[1] < min_space)
+        return -1;
+      auto node = size_t{ 1 };
+      while (node < m_leaves)
+        node = (m_tree[node * 2] >= min_space ? node * 2 : node * 2 + 1);
+      return to_int(node - m_leaves);
+    }
+
+    void add(int space) {
+      if (m_count == m_leaves) {
+        const auto leaves = std::max(m_leaves * 2, size_t{ 64 });
+        auto tree = std::vector<int>(leaves * 2, -1);
+        std::copy_n(m_tree.begin() + to_int(m_leaves), m_count,
+          tree.begin() + to_int(leaves));
+        m_tree = std::move(tree);
+        m_leaves = leaves;
+        for (auto node = m_leaves - 1; node > 0; --node)
+          m_tree[node] = std::max(m_tree[node * 2], m_tree[node * 2 + 1]);
+      }
+      update(m_count++, space);
+    }
+
+    void update(size_t index, int space) {
+      auto node = index + m_leaves;
+      m_tree[node] = space;
+      for (node /= 2; node > 0; node /= 2)
+        m_tree[node] = std::max(m_tree[node * 2], m_tree[node * 2 + 1]);
+    }
+
+  private:
+    std::vector<int> m_tree;
+    size_t m_leaves{ };
+    size_t m_count{ };
+  };
+
+  struct Shelf {
+    int slice_index;
+    int x;
+    int y;
+  };
+
+  // sizes are transposed for columns, so they can be packed like rows
+  Size get_size(const Sprite& sprite, bool horizontal) {
+    const auto size = (sprite.rotated ?
+      Size{ sprite.size.y, sprite.size.x } : sprite.size);
+    return (horizontal ? size : Size{ size.y, size.x });
+  }
+
+  int get_shelf_width(const Sheet& sheet, SpriteSpan sprites, int max_width,
+      bool horizontal) {
+    if (horizontal ? sheet.width : sheet.height)
+      return max_width;
+
+    // aim for a square sheet, when width is not fixed
+    auto area = real{ };
+    auto width = 0;
+    for (const auto& sprite : sprites) {
+      const auto size = get_size(sprite, horizontal);
+      if (sheet.border_padding * 2 + size.x > max_width)
+        continue;
+      area += to_real(size.x + sheet.shape_padding) *
+              to_real(size.y + sheet.shape_padding);
+      width = std::max(width, size.x + sheet.border_padding * 2);
+    }
+    return std::min(max_width, std::max(width,
+      floor_to_int(std::ceil(std::sqrt(area))) + sheet.border_padding * 2));
+  }
+} // namespace
+
+void pack_shelf(const SheetPtr& sheet_ptr, SpriteSpan sprites,
+    std::vector<Slice>& slices, bool horizontal) {
+  const auto& sheet = *sheet_ptr;
+  auto [max_width, max_height] = get_slice_max_size(sheet);
+  if (!horizontal)
+    std::swap(max_width, max_height);
+  const auto max_y = max_height - sheet.border_padding;
+  const auto max_slice_count = get_max_slice_count(sheet);
+
+  // lay sprites flat in rows and upright in columns,
+  // when this does not exceed the width
+  for (auto& sprite : sprites) {
+    const auto size = (horizontal ? sprite.size :
+      Size{ sprite.size.y, sprite.size.x });
+    sprite.slice_index = -1;
+    sprite.rotated = (sheet.allow_rotate && size.y > size.x &&
+      int64_t{ sheet.border_padding } * 2 + size.y <= max_width);
+  }
+  const auto shelf_width = get_shelf_width(sheet, sprites, max_width,
+    horizontal);
+  const auto max_x = shelf_width - sheet.border_padding;
+
+  // first fit decreasing height
+  auto order = std::vector<Sprite*>();
+  order.reserve(sprites.size());
+  for (auto& sprite : sprites)
+    order.push_back(&sprite);
+  std::sort(order.begin(), order.end(),
+    [&](const Sprite* a, const Sprite* b) {
+      const auto size_a = get_size(*a, horizontal);
+      const auto size_b = get_size(*b, horizontal);
+      return std::tie(size_b.y, size_b.x, a->index) <
+             std::tie(size_a.y, size_a.x, b->index);
+    });
+
+  auto shelves = std::vector<Shelf>();
+  auto shelf_index = ShelfIndex();
+  auto slice_count = 0;
+  auto slice_y = 0;
+  for (auto* sprite : order) {
+    const auto size = get_size(*sprite, horizontal);
+    if (sheet.border_padding + size.x > max_x ||
+        sheet.border_padding + size.y > max_y)
+      continue;
+
+    auto index = shelf_index.find_first(size.x);
+    if (index < 0) {
+      // open a new shelf, on a new slice when necessary
+      if (slice_count == 0 || slice_y + size.y > max_y) {
+        if (slice_count == max_slice_count)
+          continue;
+        ++slice_count;
+        slice_y = sheet.border_padding;
+      }
+      index = to_int(shelves.size());
+      shelves.push_back({ slice_count - 1, sheet.border_padding, slice_y });
+      shelf_index.add(max_x - sheet.border_padding);
+      slice_y += size.y + sheet.shape_padding;
+    }
+
+    auto& shelf = shelves[to_unsigned(index)];
+    sprite->slice_index = shelf.slice_index;
+    sprite->rect.x = (horizontal ? shelf.x : shelf.y);
+    sprite->rect.y = (horizontal ? shelf.y : shelf.x);
+    shelf.x += size.x + sheet.shape_padding;
+    shelf_index.update(to_unsigned(index), max_x - shelf.x);
+  }
+
+  // unpacked sprites keep the initial orientation
+  for (auto& sprite : sprites)
+    if (sprite.slice_index < 0)
+      sprite.rotated = false;
+
+  create_slices_from_indices(sheet_ptr, sprites, slices);
+}
+
+} // namespace
@@ -1,6 +1,8 @@
 
 #include "packing.h"
 #include <unordered_set>
+#include <unordered_map>
+#include <iterator>
 
 namespace spright {
 
@@ -196,9 +198,24 @@ namespace {
   }
 
   void pack_slice(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+      SpriteSpan sprites, std::vector<Slice>& slices,
+      const SheetLayout& previous_layout) {
     assert(!sprites.empty());
 
+    // hashes are stored in the layout
+    if (sheet->incremental)
+      update_sprite_hashes(sprites);
+
+    if (sheet->incremental && sheet->pack == Pack::binpack &&
+        !previous_layout.sprites.empty() &&
+        pack_incremental(sheet, sprites, slices, previous_layout))
+      return;
+
+    // uniform sizes can be laid out directly
+    if (sheet->pack == Pack::binpack && sprites.size() > 1000 &&
+        has_uniform_size(sprites))
+      return pack_grid(sheet, sprites, slices);
+
     switch (sheet->pack) {
       case Pack::binpack: return pack_binpack(sheet, sprites, slices, sprites.size() > 1000);
       case Pack::compact: return pack_compact(sheet, sprites, slices);
@@ -206,36 +223,56 @@ namespace {
       case Pack::keep: return pack_keep(sheet, sprites, slices);
       case Pack::rows: return pack_lines(sheet, sprites, slices, true);
       case Pack::columns: return pack_lines(sheet, sprites, slices, false);
+      case Pack::shelf: return pack_shelf(sheet, sprites, slices, true);
+      case Pack::shelf_columns: return pack_shelf(sheet, sprites, slices, false);
+      case Pack::hierarchical: return pack_hierarchical(sheet, sprites, slices);
+      case Pack::polygon: return pack_polygon(sheet, sprites, slices);
+      case Pack::grid: return pack_grid(sheet, sprites, slices);
       case Pack::origin: return pack_origin(sheet, sprites, slices, false);
       case Pack::layers: return pack_origin(sheet, sprites, slices, true);
     }
   }
 
   void pack_slice_deduplicate(const SheetPtr& sheet,
-      SpriteSpan sprites, std::vector<Slice>& slices) {
+      SpriteSpan sprites, std::vector<Slice>& slices,
+      const SheetLayout& previous_layout) {
     assert(!sprites.empty());
 
+    update_sprite_hashes(sprites);
+
+    // find first identical sprite, only comparing sprites with equal hash
+    auto duplicate_of = std::vector<int>(sprites.size(), -1);
+    auto sprites_by_hash = std::unordered_map<uint64_t, std::vector<size_t>>();
+    for (auto i = size_t{ }; i < sprites.size(); ++i) {
+      auto& bucket = sprites_by_hash[sprites[i].hash];
+      const auto it = std::find_if(bucket.begin(), bucket.end(),
+        [&](size_t j) {
+          const auto pin_i = sprites[i].source->pin();
+          const auto pin_j = sprites[j].source->pin();
+          return is_identical(
+            sprites[i].source->image(), sprites[i].trimmed_source_rect,
+            sprites[j].source->image(), sprites[j].trimmed_source_rect);
+        });
+      if (it != bucket.end())
+        duplicate_of[i] = sprites[*it].index;
+      else
+        bucket.push_back(i);
+    }
+
     // sort duplicates to back
     auto unique_sprites = sprites;
-    for (auto i = sprites.size() - 1; ; --i) {
-      for (auto j = size_t{ }; j < i; ++j) {
-        if (is_identical(sprites[i].source->image(), sprites[i].trimmed_source_rect,
-                         sprites[j].source->image(), sprites[j].trimmed_source_rect)) {
-          sprites[i].duplicate_of_index = sprites[j].index;
-          std::swap(sprites[i], unique_sprites.back());
-          unique_sprites = unique_sprites.first(unique_sprites.size() - 1);
-          break;
-        }
+    for (auto i = sprites.size(); i-- > 0; )
+      if (duplicate_of[i] >= 0) {
+        sprites[i].duplicate_of_index = duplicate_of[i];
+        std::swap(sprites[i], unique_sprites.back());
+        unique_sprites = unique_sprites.first(unique_sprites.size() - 1);
       }
-      if (i == 0)
-        break;
-    }
 
     // restore order of unique sprites before packing
     std::sort(unique_sprites.begin(), unique_sprites.end(),
       [](const Sprite& a, const Sprite& b) { return (a.index < b.index); });
 
-    pack_slice(sheet, unique_sprites, slices);
+    pack_slice(sheet, unique_sprites, slices, previous_layout);
 
     const auto duplicate_sprites = sprites.last(sprites.size() - unique_sprites.size());
     if (sheet->duplicates == Duplicates::drop) {
@@ -256,7 +293,8 @@ namespace {
     }
   }
 
-  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites) {
+  std::vector<Slice> pack_sprites_by_sheet(SpriteSpan sprites,
+      const Layout& previous_layout) {
     if (sprites.empty())
       return { };
 
@@ -267,20 +305,45 @@ namespace {
                std::tie(b.sheet->index, b.index);
       });
 
-    auto slices = std::vector<Slice>();
+    struct SheetSprites {
+      SpriteSpan sprites;
+      std::vector<Slice> slices;
+    };
+    auto sheets = std::vector<SheetSprites>();
     for (auto begin = sprites.begin(), it = begin; ; ++it)
       if (it == sprites.end() ||
           it->sheet != begin->sheet) {
-        const auto& sheet = begin->sheet;
-        if (sheet->duplicates != Duplicates::keep)
-          pack_slice_deduplicate(sheet, { begin, it }, slices);
-        else
-          pack_slice(sheet, { begin, it }, slices);
-
+        sheets.push_back({ { begin, it }, { } });
         if (it == sprites.end())
           break;
         begin = it;
       }
+
+    // sheets are independent, pack each in its own task
+    static const auto no_layout = SheetLayout{ };
+    scheduler.for_each_parallel(sheets,
+      [&](SheetSprites& sheet_sprites) {
+        auto& [sprites, slices] = sheet_sprites;
+        const auto& sheet = sprites.front().sheet;
+        const auto it = previous_layout.find(sheet->id);
+        const auto& sheet_layout = (it != previous_layout.end() ?
+          it->second : no_layout);
+        if (sheet->duplicates != Duplicates::keep)
+          pack_slice_deduplicate(sheet, sprites, slices, sheet_layout);
+        else
+          pack_slice(sheet, sprites, slices, sheet_layout);
+      });
+
+    // merge in order of sheets, offset sheet's slice indices
+    auto slices = std::vector<Slice>();
+    for (auto& [sheet_sprites, sheet_slices] : sheets) {
+      const auto offset = to_int(slices.size());
+      for (auto& sprite : sheet_sprites)
+        if (sprite.slice_index >= 0)
+          sprite.slice_index += offset;
+      std::move(sheet_slices.begin(), sheet_slices.end(),
+        std::back_inserter(slices));
+    }
     return slices;
   }
 
@@ -309,7 +372,8 @@ std::pair<int, int> get_slice_max_size(const Sheet& sheet) {
   };
 }
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+    const Layout& previous_layout) {
   for (auto& sprite : sprites)
     initialize_sprite_size(sprite);
 
@@ -330,7 +394,7 @@ std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites) {
     apply_pack_margin_before_packing(sprite);
   }
 
-  auto slices = pack_sprites_by_sheet(sprites);
+  auto slices = pack_sprites_by_sheet(sprites, previous_layout);
 
   for (auto& sprite : sprites) {
     apply_pack_margin_after_packing(sprite);
@@ -396,18 +460,68 @@ void recompute_slice_size(Slice& slice) {
     max_y = std::max(max_y, sprite.rect.y - sprite.pack_margin.y0 +
       (sprite.rotated ? sprite.size.x : sprite.size.y));
   }
-  slice.width = std::max(sheet.width, max_x + sheet.border_padding);
-  slice.height = std::max(sheet.height, max_y + sheet.border_padding);
+  std::tie(slice.width, slice.height) = get_slice_size(sheet, max_x, max_y);
+}
+
+void slide_sprites_up_left(Slice& slice) {
+  const auto& sheet = *slice.sheet;
+  const auto get_rect = [&](const Sprite& sprite) {
+    return Rect{ sprite.rect.x, sprite.rect.y,
+      (sprite.rotated ? sprite.size.y : sprite.size.x) + sheet.shape_padding,
+      (sprite.rotated ? sprite.size.x : sprite.size.y) + sheet.shape_padding };
+  };
+  auto order = std::vector<Sprite*>();
+  auto max_x = 0;
+  auto max_y = 0;
+  for (auto& sprite : slice.sprites) {
+    order.push_back(&sprite);
+    const auto rect = get_rect(sprite);
+    max_x = std::max(max_x, rect.x1());
+    max_y = std::max(max_y, rect.y1());
+  }
+
+  // moving a sprite up stops at the skyline of the sprites above it,
+  // which were already moved. Then left, until nothing moves.
+  for (auto pass = 0, unmoved = 0; unmoved < 2 && pass < 4; ++pass) {
+    const auto up = (pass % 2 == 0);
+    std::sort(order.begin(), order.end(), [&](const Sprite* a, const Sprite* b) {
+      return (up ?
+        std::tie(a->rect.y, a->rect.x) < std::tie(b->rect.y, b->rect.x) :
+        std::tie(a->rect.x, a->rect.y) < std::tie(b->rect.x, b->rect.y));
+    });
+    auto skyline = std::vector<int>(to_unsigned(up ? max_x : max_y),
+      sheet.border_padding);
+    auto moved = false;
+    for (auto* sprite : order) {
+      const auto rect = get_rect(*sprite);
+      const auto begin = skyline.begin() + (up ? rect.x : rect.y);
+      const auto end = skyline.begin() + (up ? rect.x1() : rect.y1());
+      const auto top = *std::max_element(begin, end);
+      auto& position = (up ? sprite->rect.y : sprite->rect.x);
+      if (top < position) {
+        position = top;
+        moved = true;
+      }
+      std::fill(begin, end, top + (up ? rect.h : rect.w));
+    }
+    unmoved = (moved ? 0 : unmoved + 1);
+  }
+}
+
+std::pair<int, int> get_slice_size(const Sheet& sheet, int max_x, int max_y) {
+  auto width = std::max(sheet.width, max_x + sheet.border_padding);
+  auto height = std::max(sheet.height, max_y + sheet.border_padding);
 
   if (sheet.divisible_width)
-    slice.width = ceil(slice.width, sheet.divisible_width);
+    width = ceil(width, sheet.divisible_width);
 
   if (sheet.power_of_two) {
-    slice.width = ceil_to_pot(slice.width);
-    slice.height = ceil_to_pot(slice.height);
+    width = ceil_to_pot(width);
+    height = ceil_to_pot(height);
   }
   if (sheet.square)
-    slice.width = slice.height = std::max(slice.width, slice.height);
+    width = height = std::max(width, height);
+  return { width, height };
 }
 
 void update_last_source_written_times(std::vector<Slice>& slices) {
@@ -426,4 +540,15 @@ void update_last_source_written_times(std::vector<Slice>& slices) {
     });
 }
 
+void update_sprite_hashes(SpriteSpan sprites) {
+  // hashes of deduplicated sprites are already set
+  scheduler.for_each_parallel(sprites.size(), [&](size_t i) {
+    auto& sprite = sprites[i];
+    if (sprite.hash)
+      return;
+    const auto pin = sprite.source->pin();
+    sprite.hash = get_hash(sprite.source->image(), sprite.trimmed_source_rect);
+  });
+}
+
 } // namespace
@@ -14,17 +14,46 @@ struct Slice {
   int height{ };
   int index{ };
   bool layered{ };
+  int compact_iterations{ };
 
   std::optional<std::filesystem::file_time_type> last_source_written_time;
 };
 
+// position of a sprite in a previous run
+struct LayoutSprite {
+  std::string key;
+  uint64_t hash{ };
+  Size size{ };
+  int slice_index{ };
+  Point position{ };
+  bool rotated{ };
+};
+struct SheetLayout {
+  int border_padding{ };
+  int shape_padding{ };
+  std::vector<LayoutSprite> sprites;
+};
+using Layout = std::map<std::string, SheetLayout, std::less<>>;
+
 std::pair<int, int> get_slice_max_size(const Sheet& sheet);
+std::pair<int, int> get_slice_size(const Sheet& sheet, int max_x, int max_y);
 void create_slices_from_indices(const SheetPtr& sheet_ptr, 
     SpriteSpan sprites, std::vector<Slice>& slices);
 void recompute_slice_size(Slice& slice);
+void slide_sprites_up_left(Slice& slice);
 void update_last_source_written_times(std::vector<Slice>& slices);
+void update_sprite_hashes(SpriteSpan sprites);
+
+std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites,
+  const Layout& previous_layout = { });
+
+std::string get_layout_key(const Sprite& sprite);
+Layout load_layout(const std::filesystem::path& filename);
+void save_layout(const std::filesystem::path& filename,
+  const std::vector<Sprite>& sprites, const std::vector<Slice>& slices);
 
-std::vector<Slice> pack_sprites(std::vector<Sprite>& sprites);
+bool pack_incremental(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices, const SheetLayout& previous_layout);
 
 void pack_binpack(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices, bool fast);
@@ -36,6 +65,15 @@ void pack_keep(const SheetPtr& sheet, SpriteSpan sprites,
   std::vector<Slice>& slices);
 void pack_lines(const SheetPtr& sheet, SpriteSpan sprites, 
   std::vector<Slice>& slices, bool horizontal);
+void pack_shelf(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices, bool horizontal);
+void pack_hierarchical(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices);
+void pack_polygon(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices);
+bool has_uniform_size(SpriteSpan sprites);
+void pack_grid(const SheetPtr& sheet, SpriteSpan sprites,
+  std::vector<Slice>& slices);
 void pack_origin(const SheetPtr& sheet,  SpriteSpan sprites, 
   std::vector<Slice>& slices, bool layered);
 
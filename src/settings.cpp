@@ -2,6 +2,7 @@
 #include "settings.h"
 #include "common.h"
 #include <algorithm>
+#include <charconv>
 #include <iostream>
 #include <iterator>
 
@@ -61,6 +62,23 @@ bool interpret_commandline(Settings& settings, int argc, const char* argv[]) {
         return false;
       settings.output_path = utf8_to_path(unquote(argv[i]));
     }
+    else if (argument == "--memory-limit") {
+      if (++i >= argc)
+        return false;
+      const auto value = std::string_view(argv[i]);
+      auto megabytes = 0;
+      const auto [end, ec] = std::from_chars(value.data(),
+        value.data() + value.size(), megabytes);
+      if (ec != std::errc{ } || end != value.data() + value.size() ||
+          megabytes <= 0)
+        return false;
+      settings.memory_limit = to_unsigned(megabytes) * size_t{ 1024 * 1024 };
+    }
+    else if (argument == "--cache") {
+      if (++i >= argc)
+        return false;
+      settings.cache_path = utf8_to_path(unquote(argv[i]));
+    }
     else if (argument == "-v" || argument == "--verbose") {
       settings.verbose = true;
     }
@@ -116,6 +134,8 @@ void print_help_message(const char* argv0) {
     "                     completed input definition (defaults to --input).\n"
     "  -t, --template <file>   template for the output description.\n"
     "  -p, --path <path>       path to prepend to all output files.\n"
+    "  --memory-limit <MiB>    limits the memory of decoded input images.\n"
+    "  --cache <path>          caches decoded input images in directory.\n"
     "  -v, --verbose           enable verbose messages.\n"
     "  -h, --help              print this help.\n"
     "\n"
@@ -125,4 +145,10 @@ void print_help_message(const char* argv0) {
     "\n";
 }
 
+std::filesystem::path get_layout_filename(const Settings& settings) {
+  auto filename = (settings.output_file == "stdout" ?
+    std::filesystem::path(Settings::default_output_file) : settings.output_file);
+  return settings.output_path / filename.replace_extension(".layout.json");
+}
+
 } // namespace
@@ -25,9 +25,12 @@ struct Settings {
   std::filesystem::path template_file;
   std::string complete_pattern;
   bool verbose{ };
+  size_t memory_limit{ };
+  std::filesystem::path cache_path;
 };
 
 bool interpret_commandline(Settings& settings, int argc, const char* argv[]);
 void print_help_message(const char* argv0);
+std::filesystem::path get_layout_filename(const Settings& settings);
 
 } // namespace
@@ -5,7 +5,7 @@ namespace spright {
 
 namespace {
   void transform_image(Image& image, const TransformStep& step, 
-      const Image& source) {
+      RGBA background) {
     std::visit(overloaded{
       [&](const TransformScale& scale) {
         image = resize_image(image, scale.scale, scale.scale_filter);
@@ -22,7 +22,6 @@ namespace {
         image = resize_image(image, scale, resize.scale_filter);
       },
       [&](const TransformRotate& rotate) {
-        const auto background = guess_colorkey(source);
         image = rotate_image(image, rotate.angle, background, rotate.rotate_method);
       }
     }, step);
@@ -30,10 +29,23 @@ namespace {
 
   void transform_image(Image& image, 
       const std::vector<TransformPtr>& transforms, 
-      const Image& source_image) {
+      RGBA background) {
     for (const auto& transform : transforms)
       for (const auto& step : *transform)
-        transform_image(image, step, source_image);
+        transform_image(image, step, background);
+  }
+
+  // colorkey of source, as it is after applying the filter
+  RGBA guess_colorkey(const Image& source, PixelFilter filter, RGBA filter_color) {
+    const auto source_rgba = source.view<RGBA>();
+    auto corners = Image(2, 2, RGBA{ });
+    const auto corners_rgba = corners.view<RGBA>();
+    for (auto y = 0; y < 2; ++y)
+      for (auto x = 0; x < 2; ++x)
+        corners_rgba.value_at({ x, y }) = source_rgba.value_at(
+          { x * (source.width() - 1), y * (source.height() - 1) });
+    apply_pixel_filter(corners, filter, filter_color);
+    return guess_colorkey(corners);
   }
 
   void transform_scale(SizeF& scale, const TransformStep& step) {
@@ -52,14 +64,16 @@ namespace {
   }
 } // namespace
 
-void transform_sprites(std::vector<Sprite>& sprites) {
+void transform_sprites(span<Sprite> sprites) {
   for (auto& sprite : sprites)
     if (!sprite.transforms.empty()) {
       sprite.untransformed_source = sprite.source;
       sprite.untransformed_source_rect = sprite.source_rect;
 
+      const auto pin = sprite.source->pin();
       auto image = convert_to_linear(sprite.source->image(), sprite.source_rect);
-      transform_image(image, sprite.transforms, sprite.source->image());
+      transform_image(image, sprite.transforms,
+        guess_colorkey(sprite.source->image()));
 
       sprite.source = std::make_shared<ImageFile>(
         convert_to_srgb(image), sprite.source->path(), 
@@ -79,12 +93,17 @@ void restore_untransformed_sources(std::vector<Sprite>& sprites) {
 }
 
 Image transform_output(Image&& source, 
-    const std::vector<TransformPtr>& transforms) {
-  if (transforms.empty())
+    const std::vector<TransformPtr>& transforms,
+    PixelFilter filter, RGBA filter_color) {
+  if (transforms.empty()) {
+    apply_pixel_filter(source, filter, filter_color);
     return std::move(source);
+  }
 
-  auto image = convert_to_linear(source);
-  transform_image(image, transforms, source);
+  // filter is applied while converting
+  auto image = convert_to_linear(source, { }, filter, filter_color);
+  transform_image(image, transforms,
+    guess_colorkey(source, filter, filter_color));
   return convert_to_srgb(image);
 }
 
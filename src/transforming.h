@@ -4,10 +4,11 @@
 
 namespace spright {
 
-void transform_sprites(std::vector<Sprite>& sprites);
+void transform_sprites(span<Sprite> sprites);
 void restore_untransformed_sources(std::vector<Sprite>& sprites);
 Image transform_output(Image&& source, 
-  const std::vector<TransformPtr>& transforms);
+  const std::vector<TransformPtr>& transforms,
+  PixelFilter filter = PixelFilter::none, RGBA filter_color = { });
 SizeF get_transform_scale(const std::vector<TransformPtr>& transforms);
 
 } // namespace
@@ -150,8 +150,9 @@ namespace {
   void trim_sprite(Sprite& sprite) {
     
     if (sprite.trim != Trim::none) {
-      sprite.trimmed_source_rect = get_used_rect(sprite.source->image(),
-        sprite.trim_gray_levels, sprite.trim_threshold, sprite.source_rect);
+      sprite.trimmed_source_rect = sprite.source->occupancy(
+        sprite.trim_gray_levels, sprite.trim_threshold).get_used_rect(
+        sprite.source_rect);
   
       sprite.trimmed_source_rect = intersect(expand(
         sprite.trimmed_source_rect, sprite.trim_margin), sprite.source_rect);
@@ -161,6 +162,7 @@ namespace {
     }
 
     if (sprite.trim == Trim::convex) {
+      const auto pin = sprite.source->pin();
       const auto levels = (sprite.trim_gray_levels ?
         get_gray_levels(sprite.source->image(), sprite.trimmed_source_rect) :
         get_alpha_levels(sprite.source->image(), sprite.trimmed_source_rect));
@@ -186,8 +188,8 @@ namespace {
   }
 } // namespace
 
-void trim_sprites(std::vector<Sprite>& sprites) {
-  scheduler.for_each_parallel(sprites, trim_sprite);
+void trim_sprites(span<Sprite> sprites) {
+  scheduler.for_each_parallel(sprites.begin(), sprites.end(), trim_sprite);
 }
 
 } // namespace
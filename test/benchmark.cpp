@@ -0,0 +1,188 @@
+
+#include "src/packing.h"
+#include "generate_sprites.h"
+#include "nlohmann/json.hpp"
+#include <chrono>
+#include <iostream>
+#include <functional>
+
+using namespace spright;
+
+namespace {
+  const auto max_sheet_size = 4096;
+
+  struct Distribution {
+    const char* name;
+    std::function<std::vector<GeneratePackSizes>(int count)> types;
+  };
+
+  const auto distributions = std::initializer_list<Distribution>{
+    { "uniform", [](int count) {
+        return std::vector<GeneratePackSizes>{
+          { count, 4, 4, 64, 64, false },
+        };
+      }
+    },
+    { "long-thin", [](int count) {
+        return std::vector<GeneratePackSizes>{
+          { count, 2, 16, 8, 256, true },
+        };
+      }
+    },
+    { "power-law", [](int count) {
+        // each size class is four times bigger and half as frequent
+        auto types = std::vector<GeneratePackSizes>();
+        for (auto size = 2; count > 0; size *= 4) {
+          const auto n = (size >= 512 ? count : (count + 1) / 2);
+          types.push_back({ n, size, size, size * 4, size * 4, true });
+          count -= n;
+        }
+        return types;
+      }
+    },
+  };
+
+  const auto counts = std::initializer_list<int>{ 100, 1000, 10000, 200000 };
+
+  struct PackMethod {
+    const char* name;
+    Pack pack;
+    int max_count;
+  };
+
+  const auto pack_methods = std::initializer_list<PackMethod>{
+    { "binpack", Pack::binpack, 200000 },
+    { "rows", Pack::rows, 200000 },
+    { "columns", Pack::columns, 200000 },
+    { "compact", Pack::compact, 1000 },
+    { "origin", Pack::origin, 200000 },
+    { "single", Pack::single, 200000 },
+    { "layers", Pack::layers, 200000 },
+    { "keep", Pack::keep, 200000 },
+    { "shelf", Pack::shelf, 200000 },
+    { "hierarchical", Pack::hierarchical, 200000 },
+    { "polygon", Pack::polygon, 1000 },
+    { "grid", Pack::grid, 200000 },
+  };
+
+  struct RectPackMethod {
+    const char* name;
+    rect_pack::Method method;
+    int max_count;
+  };
+
+  const auto rect_pack_methods = std::initializer_list<RectPackMethod>{
+    { "Best", rect_pack::Method::Best, 10000 },
+    { "Best_Skyline", rect_pack::Method::Best_Skyline, 200000 },
+    { "Best_MaxRects", rect_pack::Method::Best_MaxRects, 10000 },
+    { "Skyline_BottomLeft", rect_pack::Method::Skyline_BottomLeft, 200000 },
+    { "Skyline_BestFit", rect_pack::Method::Skyline_BestFit, 200000 },
+    { "MaxRects_BestShortSideFit", rect_pack::Method::MaxRects_BestShortSideFit, 10000 },
+    { "MaxRects_BestLongSideFit", rect_pack::Method::MaxRects_BestLongSideFit, 10000 },
+    { "MaxRects_BestAreaFit", rect_pack::Method::MaxRects_BestAreaFit, 10000 },
+    { "MaxRects_BottomLeftRule", rect_pack::Method::MaxRects_BottomLeftRule, 10000 },
+    { "MaxRects_ContactPointRule", rect_pack::Method::MaxRects_ContactPointRule, 10000 },
+  };
+
+  struct Result {
+    double time_ms;
+    int slice_count;
+    double occupancy;
+  };
+
+  template<typename F>
+  double measure_ms(F&& func) {
+    using Clock = std::chrono::steady_clock;
+    const auto begin = Clock::now();
+    func();
+    return std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+  }
+
+  Result run_rect_pack(const std::vector<rect_pack::Size>& sizes,
+      rect_pack::Method method) {
+    auto settings = rect_pack::Settings{ };
+    settings.method = method;
+    settings.allow_rotate = true;
+    settings.max_width = max_sheet_size;
+    settings.max_height = max_sheet_size;
+
+    auto sheets = std::vector<rect_pack::Sheet>();
+    const auto time_ms = measure_ms([&]() { sheets = rect_pack::pack(settings, sizes); });
+
+    auto used = 0.0;
+    auto total = 0.0;
+    for (const auto& sheet : sheets) {
+      for (const auto& rect : sheet.rects)
+        used += static_cast<double>(rect.width) * rect.height;
+      total += static_cast<double>(sheet.width) * sheet.height;
+    }
+    return { time_ms, static_cast<int>(sheets.size()),
+      (total > 0 ? used / total : 0.0) };
+  }
+
+  Result run_pack_sprites(const std::vector<rect_pack::Size>& sizes, Pack pack) {
+    auto sheet = std::make_shared<Sheet>();
+    sheet->id = "benchmark";
+    sheet->pack = pack;
+    sheet->allow_rotate = true;
+    sheet->max_width = max_sheet_size;
+    sheet->max_height = max_sheet_size;
+
+    auto sprites = generate_sprites(sheet, sizes);
+    auto slices = std::vector<Slice>();
+    const auto time_ms = measure_ms([&]() { slices = pack_sprites(sprites); });
+
+    auto used = 0.0;
+    auto total = 0.0;
+    for (const auto& slice : slices) {
+      for (const auto& sprite : slice.sprites)
+        used += static_cast<double>(sprite.size.x) * sprite.size.y;
+      total += static_cast<double>(slice.width) * slice.height;
+    }
+    return { time_ms, static_cast<int>(slices.size()),
+      (total > 0 ? used / total : 0.0) };
+  }
+
+  nlohmann::json to_json(const char* distribution, int count,
+      const char* packer, const char* method, const Result& result) {
+    return {
+      { "distribution", distribution },
+      { "count", count },
+      { "packer", packer },
+      { "method", method },
+      { "timeMs", result.time_ms },
+      { "slices", result.slice_count },
+      { "occupancy", result.occupancy },
+    };
+  }
+} // namespace
+
+int main(int argc, const char* argv[]) try {
+  const auto max_count = (argc > 1 ? std::stoi(argv[1]) : 200000);
+
+  auto results = nlohmann::json::array();
+  for (const auto& distribution : distributions)
+    for (auto count : counts) {
+      if (count > max_count)
+        continue;
+      const auto sizes = generate_pack_sizes(distribution.types(count));
+
+      for (const auto& method : rect_pack_methods)
+        if (count <= method.max_count)
+          results.push_back(to_json(distribution.name, count, "rect_pack",
+            method.name, run_rect_pack(sizes, method.method)));
+
+      for (const auto& method : pack_methods)
+        if (count <= method.max_count)
+          results.push_back(to_json(distribution.name, count, "pack",
+            method.name, run_pack_sprites(sizes, method.pack)));
+
+      std::cerr << distribution.name << " " << count << " done" << std::endl;
+    }
+  std::cout << results.dump(2) << std::endl;
+  return 0;
+}
+catch (const std::exception& ex) {
+  std::cerr << "ERROR: " << ex.what() << std::endl;
+  return 1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "rect_pack/rect_pack.h"
+#include <random>
+#include <vector>
+
+struct GeneratePackSizes {
+  int count;
+  int min_width;
+  int min_height;
+  int max_width;
+  int max_height;
+  bool rotate;
+};
+
+inline std::vector<rect_pack::Size> generate_pack_sizes(
+    const std::vector<GeneratePackSizes>& types) {
+  auto rand = std::minstd_rand0();
+  const auto random = [&](int min, int max) -> int {
+    if (max <= min)
+      return max;
+    return min + rand() % (max - min + 1);
+  };
+  auto id = 0;
+  auto sizes = std::vector<rect_pack::Size>();
+  for (const auto& type : types) {
+    for (auto i = 0; i < type.count; ++i) {
+      auto w = random(type.min_width, type.max_width);
+      auto h = random(type.min_height, type.max_height);
+      if (type.rotate && random(0, 1))
+        std::swap(w, h);
+      sizes.push_back({ id++, w, h });
+    }
+  }
+  return sizes;
+}
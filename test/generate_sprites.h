@@ -0,0 +1,30 @@
+#pragma once
+
+#include "src/packing.h"
+#include "generate_pack_sizes.h"
+
+// sprites of the given sizes, all referring to a tiny generated source
+inline std::vector<spright::Sprite> generate_sprites(
+    const spright::SheetPtr& sheet, const std::vector<rect_pack::Size>& sizes) {
+  using namespace spright;
+  const auto source = std::make_shared<ImageFile>(
+    Image(1, 1, RGBA{ }), "", "generated");
+  auto sprites = std::vector<Sprite>();
+  sprites.reserve(sizes.size());
+  for (const auto& size : sizes) {
+    auto& sprite = sprites.emplace_back();
+    sprite.index = size.id;
+    sprite.sheet = sheet;
+    sprite.source = source;
+    sprite.source_rect = { 0, 0, size.width, size.height };
+    sprite.trimmed_source_rect = sprite.source_rect;
+    sprite.divisible_size = { 1, 1 };
+    sprite.outline = {
+      { 0, 0 },
+      { to_real(size.width), 0 },
+      { to_real(size.width), to_real(size.height) },
+      { 0, to_real(size.height) },
+    };
+  }
+  return sprites;
+}
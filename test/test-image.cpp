@@ -0,0 +1,687 @@
+
+#include "catch.hpp"
+#include "src/image.h"
+#include "stb/stb_image_resize2.h"
+#include <random>
+
+using namespace spright;
+
+namespace {
+  Rect get_used_rect_reference(const Image& image, bool gray_levels,
+      int threshold, const Rect& rect) {
+    const auto check = (gray_levels ? is_fully_black : is_fully_transparent);
+    auto min_y = rect.y;
+    for (; min_y < rect.y1() - 1; ++min_y)
+      if (!check(image, threshold, { rect.x, min_y, rect.w, 1 }))
+        break;
+    auto max_y = rect.y1() - 1;
+    for (; max_y > min_y; --max_y)
+      if (!check(image, threshold, { rect.x, max_y, rect.w, 1 }))
+        break;
+    auto min_x = rect.x;
+    for (; min_x < rect.x1() - 1; ++min_x)
+      if (!check(image, threshold, { min_x, min_y, 1, max_y - min_y + 1 }))
+        break;
+    auto max_x = rect.x1() - 1;
+    for (; max_x > min_x; --max_x)
+      if (!check(image, threshold, { max_x, min_y, 1, max_y - min_y + 1 }))
+        break;
+    return { min_x, min_y, max_x - min_x + 1, max_y - min_y + 1 };
+  }
+
+  // bounding rects of 8-way connected pixels, found by flood filling
+  std::vector<Rect> find_components_reference(const Image& image) {
+    const auto image_rgba = image.view<RGBA>();
+    auto visited = std::vector<bool>(to_unsigned(image_rgba.size()));
+    auto components = std::vector<Rect>();
+    for (auto y = 0; y < image.height(); ++y)
+      for (auto x = 0; x < image.width(); ++x) {
+        auto stack = std::vector<Point>{ { x, y } };
+        auto rect = Rect{ };
+        while (!stack.empty()) {
+          const auto p = stack.back();
+          stack.pop_back();
+          const auto index = to_unsigned(p.y * image.width() + p.x);
+          if (!containing(image.rect(), p) || visited[index] ||
+              !image_rgba.value_at(p).a)
+            continue;
+          visited[index] = true;
+          rect = (empty(rect) ? Rect{ p.x, p.y, 1, 1 } :
+            combine(rect, { p.x, p.y, 1, 1 }));
+          for (auto dy = -1; dy <= 1; ++dy)
+            for (auto dx = -1; dx <= 1; ++dx)
+              stack.push_back({ p.x + dx, p.y + dy });
+        }
+        if (!empty(rect))
+          components.push_back(rect);
+      }
+    return components;
+  }
+
+  // testing all pairs in order, until nothing is merged
+  void merge_adjacent_rects_reference(const Image& image,
+      std::vector<Rect>& rects, int distance) {
+    const auto adjacent = [&](const Rect& a, const Rect& b) {
+      if (containing(a, b) || containing(b, a))
+        return true;
+      const auto intersection = intersect(a, expand(b, distance));
+      return (!empty(intersection) &&
+        !is_fully_transparent(image, 1, intersection));
+    };
+    for (auto merged = true; merged; ) {
+      merged = false;
+      for (auto i = size_t{ }; i < rects.size(); ++i)
+        for (auto j = i + 1; j < rects.size(); ) {
+          if (adjacent(rects[i], rects[j])) {
+            rects[i] = combine(rects[i], rects[j]);
+            rects[j] = rects.back();
+            rects.pop_back();
+            merged = true;
+          }
+          else {
+            ++j;
+          }
+        }
+    }
+  }
+
+  void sort_rects(std::vector<Rect>& rects) {
+    std::sort(rects.begin(), rects.end(), [](const Rect& a, const Rect& b) {
+      return std::tie(a.x, a.y, a.w, a.h) < std::tie(b.x, b.y, b.w, b.h);
+    });
+  }
+} // namespace
+
+TEST_CASE("image - get_used_rect") {
+  auto random = std::mt19937(1);
+  const auto random_int = [&](int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(random);
+  };
+
+  for (auto i = 0; i < 500; ++i) {
+    auto image = Image(random_int(1, 150), random_int(1, 20), RGBA{ });
+    const auto image_rgba = image.view<RGBA>();
+    const auto pixels = random_int(0, 6);
+    for (auto j = 0; j < pixels; ++j) {
+      auto& rgba = image_rgba.value_at({ random_int(0, image.width() - 1),
+                                         random_int(0, image.height() - 1) });
+      for (auto c = 0; c < 4; ++c)
+        rgba.channel(c) = RGBA::to_channel(random_int(0, 255));
+    }
+    const auto x = random_int(0, image.width() - 1);
+    const auto y = random_int(0, image.height() - 1);
+    const auto rect = Rect{ x, y,
+      random_int(1, image.width() - x), random_int(1, image.height() - y) };
+    const auto threshold = random_int(0, 256);
+
+    for (auto gray_levels : { false, true }) {
+      const auto expected = get_used_rect_reference(image, gray_levels, threshold, rect);
+      CHECK(get_used_rect(image, gray_levels, threshold, rect) == expected);
+
+      const auto occupancy = OccupancyMap(image, gray_levels, threshold);
+      CHECK(occupancy.get_used_rect(rect) == expected);
+      CHECK(occupancy.is_empty(rect) == (gray_levels ?
+        is_fully_black(image, threshold, rect) :
+        is_fully_transparent(image, threshold, rect)));
+    }
+  }
+}
+
+TEST_CASE("image - merge_adjacent_rects") {
+  auto random = std::mt19937(3);
+  const auto random_int = [&](int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(random);
+  };
+
+  for (auto i = 0; i < 200; ++i) {
+    auto image = Image(random_int(1, 200), random_int(1, 200), RGBA{ });
+    const auto image_rgba = image.view<RGBA>();
+    const auto pixels = random_int(1, image_rgba.size() / 4);
+    for (auto j = 0; j < pixels; ++j)
+      image_rgba.value_at({ random_int(0, image.width() - 1),
+        random_int(0, image.height() - 1) }).a = 255;
+
+    // merged rects and their order are the same as when testing all pairs
+    auto expected = find_components_reference(image);
+    std::shuffle(expected.begin(), expected.end(), random);
+    auto rects = expected;
+    const auto distance = random_int(0, 8);
+    merge_adjacent_rects_reference(image, expected, distance);
+    merge_adjacent_rects(OccupancyMap(image, false, 1), rects, distance);
+    CHECK(rects == expected);
+  }
+}
+
+TEST_CASE("image - find_islands") {
+  auto random = std::mt19937(2);
+  const auto random_int = [&](int min, int max) {
+    return std::uniform_int_distribution<int>(min, max)(random);
+  };
+
+  for (auto i = 0; i < 100; ++i) {
+    // taller than a stripe, to test merging at seams
+    auto image = Image(random_int(1, 80), random_int(1, 200), RGBA{ });
+    const auto image_rgba = image.view<RGBA>();
+    const auto pixels = random_int(1, image_rgba.size() / 3);
+    for (auto j = 0; j < pixels; ++j)
+      image_rgba.value_at({ random_int(0, image.width() - 1),
+        random_int(0, image.height() - 1) }).a = 255;
+
+    // without merging overlapping rects, islands are the components
+    auto components = find_components_reference(image);
+    auto islands = find_islands(image, 0, false, image.rect());
+    for (const auto& component : components)
+      CHECK(std::count_if(islands.begin(), islands.end(),
+        [&](const Rect& island) { return containing(island, component); }) == 1);
+
+    // islands do not overlap any other island's pixels
+    for (const auto& a : islands)
+      for (const auto& b : islands)
+        if (&a != &b && overlapping(a, b))
+          CHECK(is_fully_transparent(image, 1, intersect(a, b)));
+
+    // merged islands are not within distance of each other's pixels,
+    // rects are merged when the first is within distance of the second
+    const auto adjacent = [&](const Rect& a, const Rect& b) {
+      if (containing(a, b) || containing(b, a))
+        return true;
+      const auto intersection = intersect(a, expand(b, 3));
+      return (!empty(intersection) &&
+        !is_fully_transparent(image, 1, intersection));
+    };
+    islands = find_islands(image, 3, false, image.rect());
+    for (const auto& a : islands)
+      for (const auto& b : islands)
+        if (&a < &b)
+          CHECK(!(adjacent(a, b) && adjacent(b, a)));
+
+    // cached occupancy yields the same islands
+    const auto occupancy = OccupancyMap(image, false, 1);
+    CHECK(find_islands(image, occupancy, 3, image.rect()) == islands);
+    CHECK(find_islands(image, occupancy, 3) == find_islands(image, 3, false));
+  }
+
+  // bounding rects of separate components are found
+  auto image = Image(200, 150, RGBA{ });
+  fill_rect(image, { 10, 60, 5, 10 }, RGBA{ 0, 0, 0, 255 });
+  fill_rect(image, { 15, 70, 5, 10 }, RGBA{ 0, 0, 0, 255 });
+  fill_rect(image, { 100, 20, 50, 100 }, RGBA{ 0, 0, 0, 255 });
+  fill_rect(image, { 152, 20, 10, 10 }, RGBA{ 0, 0, 0, 255 });
+  auto islands = find_islands(image, 0, false, image.rect());
+  sort_rects(islands);
+  CHECK(islands == std::vector<Rect>{
+    { 10, 60, 10, 20 }, { 100, 20, 50, 100 }, { 152, 20, 10, 10 } });
+
+  islands = find_islands(image, 3, false, image.rect());
+  sort_rects(islands);
+  CHECK(islands == std::vector<Rect>{
+    { 10, 60, 10, 20 }, { 100, 20, 62, 100 } });
+}
+
+TEST_CASE("image - Linear color conversion") {
+  for (auto i = 0; i < 256; ++i) {
+    const auto c = static_cast<uint8_t>(i);
+    CHECK(linear16_to_srgb(srgb_to_linear16(c)) == c);
+    CHECK(linear_to_srgb(srgb_to_linear(c)) == c);
+    CHECK(std::abs(uint16_to_unorm(srgb_to_linear16(c)) - srgb_to_linear(c)) < 0.0001f);
+  }
+
+  auto random = std::mt19937(3);
+  auto image = Image(37, 23, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  for (auto i = 0; i < image_rgba.size(); ++i)
+    for (auto c = 0; c < 4; ++c)
+      image_rgba.values()[i].channel(c) = static_cast<uint8_t>(random() % 256);
+
+  const auto linear = convert_to_linear(image);
+  CHECK(linear.type() == ImageType::RGBA16);
+  const auto restored = convert_to_srgb(linear);
+  CHECK(is_identical(image, image.rect(), restored, restored.rect()));
+
+  // 16 bit results do not differ noticeably from float results
+  const auto linear_f = [&]() {
+    auto result = Image(ImageType::RGBAF, image.width(), image.height());
+    for (auto i = 0; i < image_rgba.size(); ++i)
+      result.view<RGBAF>().values()[i] = srgb_to_linear(image_rgba.values()[i]);
+    return result;
+  }();
+  const auto check_similar = [](const Image& a, const Image& b) {
+    const auto a_srgb = convert_to_srgb(a);
+    const auto b_srgb = convert_to_srgb(b);
+    REQUIRE(a_srgb.width() == b_srgb.width());
+    REQUIRE(a_srgb.height() == b_srgb.height());
+    auto max_difference = 0;
+    for (auto i = 0; i < a_srgb.view<RGBA>().size(); ++i)
+      for (auto c = 0; c < 4; ++c)
+        max_difference = std::max(max_difference, std::abs(
+          a_srgb.view<RGBA>().values()[i].channel(c) -
+          b_srgb.view<RGBA>().values()[i].channel(c)));
+    CHECK(max_difference <= 2);
+  };
+  check_similar(resize_image(linear, { 2.5, 1.5 }, ScaleFilter::undefined),
+    resize_image(linear_f, { 2.5, 1.5 }, ScaleFilter::undefined));
+  check_similar(resize_image(linear, { 0.5, 0.5 }, ScaleFilter::point_sample),
+    resize_image(linear_f, { 0.5, 0.5 }, ScaleFilter::point_sample));
+  check_similar(rotate_image(linear, 33, RGBA{ }, RotateMethod::bilinear),
+    rotate_image(linear_f, 33, RGBA{ }, RotateMethod::bilinear));
+  check_similar(rotate_image(linear, 90, RGBA{ }, RotateMethod::undefined),
+    rotate_image(linear_f, 90, RGBA{ }, RotateMethod::undefined));
+}
+
+TEST_CASE("image - rotate_image") {
+  auto random = std::mt19937(4);
+  auto image = Image(31, 17, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  for (auto i = 0; i < image_rgba.size(); ++i)
+    for (auto c = 0; c < 4; ++c)
+      image_rgba.values()[i].channel(c) = static_cast<uint8_t>(random() % 256);
+  const auto linear = convert_to_linear(image);
+  const auto linear_rgba = linear.view<RGBA16>();
+
+  // transforms each destination pixel separately
+  const auto rotate_reference = [&](real degrees, bool bilinear) {
+    const auto angle = deg_to_rad(degrees);
+    const auto cos = std::cos(angle);
+    const auto sin = std::sin(angle);
+    const auto w2 = linear.width() / 2.0;
+    const auto h2 = linear.height() / 2.0;
+    const auto mx = std::abs(w2 * cos) + std::abs(h2 * sin);
+    const auto my = std::abs(h2 * cos) + std::abs(w2 * sin);
+    auto expected = Image(ImageType::RGBA16,
+      round_to_int(mx * 2.0), round_to_int(my * 2.0));
+    const auto source_center = PointF(w2 - 0.5, h2 - 0.5);
+    const auto dest_center = PointF(
+      to_real(expected.width()) / 2 - 0.5, to_real(expected.height()) / 2 - 0.5);
+    const auto sample = [&](int x, int y, int c) {
+      return (containing(linear.rect(), Point(x, y)) ?
+        to_real(linear_rgba.value_at({ x, y }).channel(c)) : real{ });
+    };
+    for (auto y = 0; y < expected.height(); ++y)
+      for (auto x = 0; x < expected.width(); ++x) {
+        const auto dx = x - dest_center.x;
+        const auto dy = y - dest_center.y;
+        const auto px = dx * cos + dy * sin + source_center.x;
+        const auto py = dy * cos - dx * sin + source_center.y;
+        auto& value = expected.view<RGBA16>().value_at({ x, y });
+        for (auto c = 0; c < 4; ++c) {
+          if (!bilinear) {
+            value.channel(c) = static_cast<uint16_t>(
+              sample(round_to_int(px), round_to_int(py), c));
+            continue;
+          }
+          const auto ix = floor_to_int(std::floor(px));
+          const auto iy = floor_to_int(std::floor(py));
+          const auto rx = px - ix;
+          const auto ry = py - iy;
+          const auto top = sample(ix, iy, c) * (1 - rx) + sample(ix + 1, iy, c) * rx;
+          const auto bottom = sample(ix, iy + 1, c) * (1 - rx) + sample(ix + 1, iy + 1, c) * rx;
+          value.channel(c) = static_cast<uint16_t>(round_to_int(top * (1 - ry) + bottom * ry));
+        }
+      }
+    return expected;
+  };
+
+  const auto max_difference = [](const Image& a, const Image& b) {
+    REQUIRE(a.width() == b.width());
+    REQUIRE(a.height() == b.height());
+    auto difference = 0;
+    for (auto i = 0; i < a.view<RGBA16>().size(); ++i)
+      for (auto c = 0; c < 4; ++c)
+        difference = std::max(difference, std::abs(
+          a.view<RGBA16>().values()[i].channel(c) -
+          b.view<RGBA16>().values()[i].channel(c)));
+    return difference;
+  };
+
+  for (auto degrees : { 0.0, 90.0, 180.0, 270.0, -90.0, 33.0, 137.0, 251.0 }) {
+    CHECK(max_difference(rotate_reference(degrees, false),
+      rotate_image(linear, degrees, RGBA{ }, RotateMethod::nearest)) == 0);
+    CHECK(max_difference(rotate_reference(degrees, true),
+      rotate_image(linear, degrees, RGBA{ }, RotateMethod::bilinear)) <= 1);
+  }
+}
+
+TEST_CASE("image - copy_rect with mask") {
+  // http://paulbourke.net/geometry/polygonmesh/
+  const auto point_in_polygon = [](real x, real y, const std::vector<PointF>& p) {
+    auto c = false;
+    for (auto i = size_t{ }, j = p.size() - 1; i < p.size(); j = i++)
+      if ((((p[i].y <= y) && (y < p[j].y)) ||
+           ((p[j].y <= y) && (y < p[i].y))) &&
+          (x < (p[j].x - p[i].x) * (y - p[i].y) / (p[j].y - p[i].y) + p[i].x))
+        c = !c;
+    return c;
+  };
+
+  auto source = Image(40, 30, RGBA{ });
+  const auto source_rgba = source.view<RGBA>();
+  for (auto i = 0; i < source_rgba.size(); ++i)
+    source_rgba.values()[i] = uint32_to_rgba(static_cast<uint32_t>(i) | 0xFF000000);
+  const auto source_rect = Rect{ 5, 3, 31, 23 };
+
+  const auto outlines = std::vector<std::vector<PointF>>{
+    { { 0, 0 }, { 31, 0 }, { 31, 23 }, { 0, 23 } },
+    { { 15.5, -2 }, { 33, 11.5 }, { 15.5, 25 }, { -2, 11.5 } },
+    { { 3.3, 1.7 }, { 27.1, 4.5 }, { 20.5, 21.5 }, { 1.5, 12.5 } },
+    { { 0, 0 }, { 31, 0 }, { 15.5, 11.5 }, { 31, 23 }, { 0, 23 } },
+  };
+  for (const auto& outline : outlines) {
+    auto dest = Image(50, 50, RGBA{ });
+    copy_rect(source, source_rect, dest, 7, 9, outline);
+    auto dest_rotated = Image(50, 50, RGBA{ });
+    copy_rect_rotated_cw(source, source_rect, dest_rotated, 7, 9, outline);
+
+    for (auto y = 0; y < source_rect.h; ++y)
+      for (auto x = 0; x < source_rect.w; ++x) {
+        const auto expected = (point_in_polygon(x + 0.5, y + 0.5, outline) ?
+          source_rgba.value_at({ source_rect.x + x, source_rect.y + y }) : RGBA{ });
+        CHECK(dest.view<RGBA>().value_at({ 7 + x, 9 + y }) == expected);
+        CHECK(dest_rotated.view<RGBA>().value_at(
+          { 7 + (source_rect.h - 1 - y), 9 + x }) == expected);
+      }
+  }
+}
+
+TEST_CASE("image - Rotate by transposing") {
+  auto source = Image(77, 45, RGBA{ });
+  const auto source_rgba = source.view<RGBA>();
+  for (auto i = 0; i < source_rgba.size(); ++i)
+    source_rgba.values()[i] = uint32_to_rgba(static_cast<uint32_t>(i) | 0xFF000000);
+  const auto source_rect = Rect{ 3, 2, 71, 37 };
+  const auto at = [&](int x, int y) {
+    return source_rgba.value_at({ source_rect.x + x, source_rect.y + y });
+  };
+
+  auto dest = Image(50, 80, RGBA{ });
+  copy_rect_rotated_cw(source, source_rect, dest, 5, 4);
+  auto dest_masked = Image(50, 80, RGBA{ });
+  copy_rect_rotated_cw(source, source_rect, dest_masked, 5, 4, {
+    { 0, 0 }, { 71, 0 }, { 71, 37 }, { 40, 20 }, { 0, 37 } });
+  for (auto y = 0; y < source_rect.h; ++y)
+    for (auto x = 0; x < source_rect.w; ++x) {
+      const auto point = Point(5 + (source_rect.h - 1 - y), 4 + x);
+      CHECK(dest.view<RGBA>().value_at(point) == at(x, y));
+      const auto masked = dest_masked.view<RGBA>().value_at(point);
+      CHECK((masked == at(x, y) || masked == RGBA{ }));
+      if (y < 10)
+        CHECK(masked == at(x, y));
+    }
+
+  const auto linear = convert_to_linear(source);
+  const auto linear_rgba = linear.view<RGBA16>();
+  const auto w = linear.width();
+  const auto h = linear.height();
+  const auto cw = rotate_image(linear, 90, RGBA{ }, RotateMethod::nearest);
+  const auto half = rotate_image(linear, 180, RGBA{ }, RotateMethod::nearest);
+  const auto ccw = rotate_image(linear, 270, RGBA{ }, RotateMethod::nearest);
+  REQUIRE(cw.width() == h);
+  REQUIRE(ccw.width() == h);
+  REQUIRE(half.width() == w);
+  for (auto y = 0; y < h; ++y)
+    for (auto x = 0; x < w; ++x) {
+      const auto value = linear_rgba.value_at({ x, y });
+      CHECK(cw.view<RGBA16>().value_at({ h - 1 - y, x }) == value);
+      CHECK(half.view<RGBA16>().value_at({ w - 1 - x, h - 1 - y }) == value);
+      CHECK(ccw.view<RGBA16>().value_at({ y, w - 1 - x }) == value);
+    }
+}
+
+TEST_CASE("image - Median downsampling") {
+  auto random = std::mt19937(5);
+  const auto palette = std::array<RGBA, 4>{
+    RGBA{ 0, 0, 0, 0 }, RGBA{ 255, 0, 0, 255 },
+    RGBA{ 0, 255, 0, 255 }, RGBA{ 0, 0, 255, 128 } };
+  auto image = Image(48, 36, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  for (auto i = 0; i < image_rgba.size(); ++i)
+    image_rgba.values()[i] = palette[random() % palette.size()];
+
+  // most frequent color, ties resolve to the first encountered
+  const auto downsample_reference = [&](const SizeF& scale) {
+    auto expected = Image(ImageType::RGBA,
+      std::max(round_to_int(image.width() * scale.x), 1),
+      std::max(round_to_int(image.height() * scale.y), 1));
+    const auto fx = to_real(image.width()) / expected.width();
+    const auto fy = to_real(image.height()) / expected.height();
+    for (auto y = 0; y < expected.height(); ++y)
+      for (auto x = 0; x < expected.width(); ++x) {
+        auto buckets = std::vector<std::pair<RGBA, int>>();
+        for (auto sy = y * fy; sy < y * fy + fy; sy += 1.0)
+          for (auto sx = x * fx; sx < x * fx + fx; sx += 1.0) {
+            const auto color = image_rgba.value_at({
+              std::min(round_to_int(sx), image.width() - 1),
+              std::min(round_to_int(sy), image.height() - 1) });
+            const auto it = std::find_if(buckets.begin(), buckets.end(),
+              [&](const auto& bucket) { return bucket.first == color; });
+            if (it != buckets.end())
+              ++it->second;
+            else
+              buckets.emplace_back(color, 1);
+          }
+        expected.view<RGBA>().value_at({ x, y }) = std::max_element(
+          buckets.begin(), buckets.end(),
+          [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+      }
+    return expected;
+  };
+
+  for (const auto& scale : { SizeF(0.5, 0.5), SizeF(1 / 3.0, 1 / 3.0),
+       SizeF(0.25, 0.25), SizeF(0.37, 0.37), SizeF(0.5, 0.25), SizeF(0.1, 0.9) }) {
+    const auto expected = downsample_reference(scale);
+    const auto output = resize_image(image, scale, ScaleFilter::point_sample);
+    REQUIRE(output.width() == expected.width());
+    REQUIRE(output.height() == expected.height());
+    CHECK(is_identical(output, output.rect(), expected, expected.rect()));
+  }
+}
+
+TEST_CASE("image - Pixel filters") {
+  auto random = std::mt19937(6);
+  auto image = Image(37, 29, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  for (auto i = 0; i < image_rgba.size(); ++i) {
+    auto& rgba = image_rgba.values()[i];
+    for (auto c = 0; c < 4; ++c)
+      rgba.channel(c) = static_cast<uint8_t>(random() % 256);
+    if (i % 3 == 0)
+      rgba.a = (i % 2 ? 255 : 0);
+  }
+  const auto color = RGBA{ 10, 20, 30, 40 };
+
+  const auto filter_reference = [&](RGBA rgba, PixelFilter filter) {
+    switch (filter) {
+      case PixelFilter::none: break;
+      case PixelFilter::make_opaque: rgba.a = 255; break;
+      case PixelFilter::clear_alpha: if (!rgba.a) rgba = color; break;
+      case PixelFilter::colorkey:
+        if (!rgba.a) rgba = color; else rgba.a = 255;
+        break;
+      case PixelFilter::premultiply_alpha:
+        rgba.r = static_cast<uint8_t>(rgba.r * rgba.a / 255);
+        rgba.g = static_cast<uint8_t>(rgba.g * rgba.a / 255);
+        rgba.b = static_cast<uint8_t>(rgba.b * rgba.a / 255);
+        break;
+    }
+    return rgba;
+  };
+
+  for (auto filter : { PixelFilter::none, PixelFilter::make_opaque,
+       PixelFilter::clear_alpha, PixelFilter::colorkey,
+       PixelFilter::premultiply_alpha }) {
+    auto filtered = clone_image(image);
+    apply_pixel_filter(filtered, filter, color);
+    const auto rect = Rect{ 3, 2, 31, 25 };
+    const auto linear = convert_to_linear(image, rect, filter, color);
+    for (auto y = 0; y < image.height(); ++y)
+      for (auto x = 0; x < image.width(); ++x) {
+        const auto expected = filter_reference(image_rgba.value_at({ x, y }), filter);
+        CHECK(filtered.view<RGBA>().value_at({ x, y }) == expected);
+        if (containing(rect, Point(x, y)))
+          CHECK(linear.view<RGBA16>().value_at({ x - rect.x, y - rect.y }) ==
+            srgb_to_linear16(expected));
+      }
+  }
+}
+
+TEST_CASE("image - Parallel resize") {
+  auto random = std::mt19937(7);
+  auto image = Image(ImageType::RGBA16, 1531, 1207);
+  const auto image_rgba = image.view<RGBA16>();
+  for (auto i = 0; i < image_rgba.size(); ++i)
+    for (auto c = 0; c < 4; ++c)
+      image_rgba.values()[i].channel(c) = static_cast<uint16_t>(random() % 65536);
+
+  for (const auto& scale : { SizeF(0.5, 0.5), SizeF(1.7, 1.3), SizeF(0.3, 2.0) })
+    for (auto filter : { ScaleFilter::box, ScaleFilter::triangle, ScaleFilter::mitchell }) {
+      const auto output = resize_image(image, scale, filter);
+      auto expected = Image(ImageType::RGBA16, output.width(), output.height());
+      REQUIRE(stbir_resize(image.data().data(), image.width(), image.height(),
+        image.width() * 8, expected.data().data(), expected.width(),
+        expected.height(), expected.width() * 8, STBIR_RGBA,
+        STBIR_TYPE_UINT16, STBIR_EDGE_CLAMP, static_cast<stbir_filter>(filter)));
+      CHECK(std::memcmp(output.data().data(), expected.data().data(),
+        output.data().size_bytes()) == 0);
+    }
+}
+
+TEST_CASE("image - Write PNG") {
+  auto random = std::mt19937(8);
+  // smooth gradient with noise, larger than a deflate piece
+  auto image = Image(733, 517, RGBA{ });
+  const auto image_rgba = image.view<RGBA>();
+  for (auto y = 0; y < image.height(); ++y)
+    for (auto x = 0; x < image.width(); ++x)
+      image_rgba.value_at({ x, y }) = RGBA{
+        static_cast<uint8_t>(x),
+        static_cast<uint8_t>(y),
+        static_cast<uint8_t>(random() % 4),
+        static_cast<uint8_t>(x % 7 ? 255 : random() % 256) };
+
+  const auto filename = std::filesystem::temp_directory_path() /
+    "spright-test-write.png";
+  for (auto compression : { Compression::fast,
+       Compression::default_, Compression::max }) {
+    save_image(image, filename, compression);
+    const auto loaded = load_image(filename);
+    REQUIRE(loaded.width() == image.width());
+    REQUIRE(loaded.height() == image.height());
+    CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  }
+  std::filesystem::remove(filename);
+}
+
+TEST_CASE("image - Cache decoded images") {
+  const auto directory = std::filesystem::temp_directory_path() /
+    "spright-test-cache";
+  const auto filename = directory / "source.png";
+  std::filesystem::remove_all(directory);
+  set_image_cache_path(directory / "cache");
+
+  const auto count_entries = [&]() {
+    const auto it = std::filesystem::directory_iterator(directory / "cache");
+    return std::distance(begin(it), end(it));
+  };
+
+  auto image = Image(37, 23, RGBA{ 1, 2, 3, 4 });
+  save_image(image, filename);
+  CHECK(count_entries() == 0);
+
+  // decoded and written to cache
+  auto loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  CHECK(count_entries() == 1);
+
+  // mapped from cache
+  loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  loaded.view<RGBA>().value_at({ 0, 0 }) = RGBA{ };
+  loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+
+  // touched file content is compared
+  std::filesystem::last_write_time(filename,
+    std::filesystem::last_write_time(filename) + std::chrono::seconds(10));
+  loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+
+  // modified file is decoded again
+  image = Image(23, 37, RGBA{ 5, 6, 7, 8 });
+  save_image(image, filename);
+  std::filesystem::last_write_time(filename,
+    std::filesystem::last_write_time(filename) + std::chrono::seconds(20));
+  loaded = load_image(filename);
+  REQUIRE(loaded.width() == image.width());
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  CHECK(count_entries() == 1);
+
+  // entry of other source with same name is not used
+  const auto other_filename = directory / "other.png";
+  const auto other = Image(23, 37, RGBA{ 9, 9, 9, 9 });
+  save_image(other, other_filename);
+  load_image(other_filename);
+  CHECK(count_entries() == 2);
+  auto entries = std::vector<std::filesystem::path>();
+  for (const auto& entry : std::filesystem::directory_iterator(directory / "cache"))
+    entries.push_back(entry.path());
+  std::filesystem::copy_file(entries[0], entries[1],
+    std::filesystem::copy_options::overwrite_existing);
+  loaded = load_image(filename);
+  CHECK(is_identical(loaded, loaded.rect(), image, image.rect()));
+  loaded = load_image(other_filename);
+  CHECK(is_identical(loaded, loaded.rect(), other, other.rect()));
+  CHECK(count_entries() == 2);
+
+  loaded = { };
+  set_image_cache_path({ });
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("image - Pooled storage") {
+  auto image = Image(ImageType::RGBA16, 100, 50, ImageStorage::pooled);
+  CHECK(image.storage() == ImageStorage::pooled);
+  const auto data = image.data().data();
+  image = Image();
+
+  // released buffer is reused for images of similar size
+  image = Image(ImageType::RGBA16, 98, 51, ImageStorage::pooled);
+  CHECK(image.data().data() == data);
+  CHECK(Image(ImageType::RGBA16, 100, 50).storage() == ImageStorage::heap);
+
+  // transient images are pooled, derived images keep the storage
+  const auto source = Image(64, 32, RGBA{ 10, 20, 30, 255 });
+  CHECK(get_alpha_levels(source, source.rect()).storage() == ImageStorage::pooled);
+  const auto linear = convert_to_linear(source);
+  CHECK(linear.storage() == ImageStorage::pooled);
+  CHECK(clone_image(linear).storage() == ImageStorage::pooled);
+  CHECK(resize_image(linear, { 2, 2 }, ScaleFilter::box).storage() == ImageStorage::pooled);
+  CHECK(rotate_image(linear, 90, { }, RotateMethod::undefined).storage() == ImageStorage::pooled);
+  CHECK(rotate_image(linear, 30, { }, RotateMethod::undefined).storage() == ImageStorage::pooled);
+  CHECK(convert_to_srgb(linear).storage() == ImageStorage::heap);
+  CHECK(clone_image(source).storage() == ImageStorage::heap);
+  const auto srgb = convert_to_srgb(linear);
+  CHECK(is_identical(srgb, srgb.rect(), source, source.rect()));
+
+  // huge images are not pooled
+  const auto huge = Image(ImageType::RGBA16, 4096, 4096, ImageStorage::pooled);
+  CHECK(huge.storage() == ImageStorage::heap);
+}
+
+TEST_CASE("image - Buffer pool limit") {
+  // released buffers are not kept, when pool is full
+  const auto pooled = get_pooled_bytes();
+  set_buffer_pool_limit(0);
+  auto image = Image(ImageType::RGBA16, 100, 50, ImageStorage::pooled);
+  image = Image();
+  CHECK(get_pooled_bytes() <= pooled);
+
+  const auto limit = get_pooled_bytes() + 1024 * 1024;
+  set_buffer_pool_limit(limit);
+  image = Image(ImageType::RGBA16, 100, 50, ImageStorage::pooled);
+  image = Image(ImageType::RGBA16, 400, 400, ImageStorage::pooled);
+  image = Image();
+  CHECK(get_pooled_bytes() > 0);
+  CHECK(get_pooled_bytes() <= limit);
+  set_buffer_pool_limit(default_buffer_pool_limit);
+}
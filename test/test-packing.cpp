@@ -6,7 +6,9 @@
 #include "src/packing.h"
 #include "src/output.h"
 #include "src/debug.h"
+#include "generate_sprites.h"
 #include <sstream>
+#include <chrono>
 
 using namespace spright;
 
@@ -35,6 +37,7 @@ namespace {
     parser.parse(input);
     static auto s_sprites = std::vector<Sprite>();
     s_sprites = std::move(parser).sprites();
+    decode_sources(s_sprites);
     transform_sprites(s_sprites);
     trim_sprites(s_sprites);
     auto slices = pack_sprites(s_sprites);
@@ -421,3 +424,548 @@ TEST_CASE("packing - Multiple sheets") {
   CHECK(slices[0].width <= 16);
   CHECK(slices[0].height <= 16);
 }
+
+TEST_CASE("packing - Incremental") {
+  const auto definition = R"(
+    sheet "sprites"
+      incremental
+    input "test/Items.png"
+      colorkey
+      atlas
+  )";
+  const auto get_positions = [&](const Layout& layout) {
+    auto input = std::stringstream(definition);
+    auto parser = InputParser(Settings{ });
+    parser.parse(input);
+    auto sprites = std::move(parser).sprites();
+    transform_sprites(sprites);
+    trim_sprites(sprites);
+    auto slices = pack_sprites(sprites, layout);
+    CHECK(slices.size() == 1);
+    for (const auto& a : sprites)
+      for (const auto& b : sprites)
+        if (&a < &b)
+          CHECK(!overlapping(a.rect, b.rect));
+    const auto filename = std::filesystem::temp_directory_path() /
+      "spright-test.layout.json";
+    save_layout(filename, sprites, slices);
+    auto positions = std::vector<Point>();
+    for (const auto& sprite : sprites)
+      positions.push_back({ sprite.rect.x, sprite.rect.y });
+    return std::make_pair(positions, load_layout(filename));
+  };
+
+  const auto [positions, layout] = get_positions({ });
+  REQUIRE(layout.count("sprites"));
+  const auto& sprites = layout.at("sprites").sprites;
+  REQUIRE(sprites.size() == positions.size());
+
+  // unchanged sprites keep their position
+  CHECK(get_positions(layout).first == positions);
+
+  // forgotten sprites are placed in free space
+  auto partial_layout = layout;
+  auto& partial_sprites = partial_layout["sprites"].sprites;
+  partial_sprites.erase(partial_sprites.begin(),
+    partial_sprites.begin() + to_int(partial_sprites.size() / 4));
+  const auto partial_positions = get_positions(partial_layout).first;
+  CHECK(std::equal(partial_positions.begin() + to_int(positions.size() / 4),
+    partial_positions.end(), positions.begin() + to_int(positions.size() / 4)));
+
+  // kept sprites keep their position, even when most sprites changed,
+  // the layout is moved to differ from the one packed from scratch
+  auto changed_layout = layout;
+  auto& changed_sprites = changed_layout["sprites"].sprites;
+  const auto changed_count = changed_sprites.size() * 2 / 3;
+  for (auto i = size_t{ }; i < changed_sprites.size(); ++i) {
+    changed_sprites[i].position.x += 1;
+    changed_sprites[i].position.y += 1;
+    if (i < changed_count)
+      ++changed_sprites[i].hash;
+  }
+  const auto changed_positions = get_positions(changed_layout).first;
+  for (auto i = changed_count; i < changed_positions.size(); ++i)
+    CHECK(changed_positions[i] == changed_sprites[i].position);
+}
+
+TEST_CASE("packing - Time limit") {
+  auto slice = pack_single_sheet(R"(
+    sheet "sprites"
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  const auto width = slice.width;
+  const auto height = slice.height;
+  const auto sprite_count = slice.sprites.size();
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack-time-limit 10
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(le_size(slice, width, height));
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack-time-limit 0.001
+      allow-rotate
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(slice.sprites.size() == sprite_count);
+
+  // elapsed time stays close to the limit
+  auto sheet = std::make_shared<Sheet>();
+  sheet->pack_time_limit = 0.2;
+  auto sizes = std::vector<rect_pack::Size>();
+  for (auto i = 0; i < 1000; ++i)
+    sizes.push_back({ i, 3 + (i * 7) % 29, 3 + (i * 5) % 23 });
+  auto sprites = generate_sprites(sheet, sizes);
+  const auto start = std::chrono::steady_clock::now();
+  const auto slices = pack_sprites(sprites);
+  const auto elapsed = std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+  CHECK(!slices.empty());
+  CHECK(elapsed < sheet->pack_time_limit + 0.5);
+}
+
+TEST_CASE("packing - Compact") {
+  auto slice = pack_single_sheet(R"(
+    sheet "sprites"
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  const auto width = slice.width;
+  const auto height = slice.height;
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack compact
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+  )");
+  CHECK(le_size(slice, width, height));
+  CHECK(slice.compact_iterations > 0);
+  CHECK(slice.compact_iterations < 1000);
+}
+
+TEST_CASE("packing - Shelf") {
+  auto slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack shelf
+      padding 1
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(le_size(slice, 72, 72));
+  for (const auto& a : slice.sprites)
+    for (const auto& b : slice.sprites)
+      if (&a != &b)
+        CHECK(!overlapping(a.rect, b.rect));
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack shelf
+      allow-rotate
+      max-width 64
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(slice.width <= 64);
+
+  auto slices = std::vector<Slice>();
+  CHECK_NOTHROW(slices = pack(R"(
+    sheet "sprites"
+      pack shelf
+      max-width 32
+      max-height 32
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"));
+  CHECK(slices.size() > 1);
+  for (const auto& slice : slices)
+    CHECK((slice.width <= 32 && slice.height <= 32));
+
+  CHECK_THROWS_AS(pack(R"(
+    sheet "sprites"
+      output "spright.png"
+      pack shelf
+      max-width 32
+      max-height 32
+    input "test/Items.png"
+      colorkey
+      atlas
+  )"), HasWarningsException);
+
+  // sprite wider than the sheet is not packed, also not on a new shelf
+  auto sheet = std::make_shared<Sheet>();
+  sheet->pack = Pack::shelf;
+  sheet->max_width = 100;
+  auto sizes = std::vector<rect_pack::Size>{ { 0, 200, 5 } };
+  for (auto i = 1; i < 32; ++i)
+    sizes.push_back({ i, 10 + i % 3, 10 });
+  auto sprites = generate_sprites(sheet, sizes);
+  slices = pack_sprites(sprites);
+  CHECK(has_warnings());
+  REQUIRE(slices.size() == 1);
+  CHECK(slices[0].width <= 100);
+  CHECK(slices[0].sprites.size() == 31);
+  CHECK(sprites[0].slice_index < 0);
+
+  // width of shelf considers orientation of sprites
+  sheet->max_width = std::numeric_limits<int>::max();
+  sizes = { { 0, 60, 4 }, { 1, 4, 4 } };
+  sprites = generate_sprites(sheet, sizes);
+  slices = pack_sprites(sprites);
+  REQUIRE(slices.size() == 1);
+  CHECK(slices[0].sprites.size() == 2);
+  CHECK(slices[0].width >= 60);
+
+  // columns are filled top to bottom
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack shelf columns
+      allow-rotate
+      max-height 64
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(slice.height <= 64);
+  for (const auto& a : slice.sprites)
+    for (const auto& b : slice.sprites)
+      if (&a != &b)
+        CHECK(!overlapping(a.rect, b.rect));
+
+  // max-height limits the length of the columns
+  sheet->pack = Pack::shelf_columns;
+  sheet->max_width = 0;
+  sheet->max_height = 100;
+  sizes = { { 0, 5, 100 } };
+  for (auto i = 1; i < 32; ++i)
+    sizes.push_back({ i, 10, 10 + i % 3 });
+  sprites = generate_sprites(sheet, sizes);
+  slices = pack_sprites(sprites);
+  REQUIRE(slices.size() == 1);
+  CHECK(slices[0].height <= 100);
+  CHECK(slices[0].sprites.size() == 32);
+  CHECK(slices[0].width < slices[0].height);
+
+  CHECK_THROWS(pack(R"(
+    sheet "sprites"
+      pack shelf diagonal
+    input "test/Items.png"
+  )"));
+}
+
+TEST_CASE("packing - Hierarchical") {
+  auto sheet = std::make_shared<Sheet>();
+  sheet->pack = Pack::hierarchical;
+  sheet->allow_rotate = true;
+  sheet->max_width = 512;
+  sheet->max_height = 512;
+  sheet->shape_padding = 1;
+  sheet->border_padding = 2;
+
+  auto sizes = std::vector<rect_pack::Size>();
+  for (auto i = 0; i < 3000; ++i)
+    sizes.push_back({ i, 3 + (i * 7) % 13, 3 + (i * 5) % 11 });
+  auto sprites = generate_sprites(sheet, sizes);
+  const auto slices = pack_sprites(sprites);
+  CHECK(!slices.empty());
+
+  for (const auto& slice : slices) {
+    CHECK(slice.width <= 512);
+    CHECK(slice.height <= 512);
+    auto rects = std::vector<Rect>();
+    for (const auto& sprite : slice.sprites) {
+      auto rect = sprite.rect;
+      if (sprite.rotated)
+        std::swap(rect.w, rect.h);
+      CHECK(rect.x >= 2);
+      CHECK(rect.y >= 2);
+      CHECK(rect.x1() <= slice.width - 2);
+      CHECK(rect.y1() <= slice.height - 2);
+      rects.push_back({ rect.x, rect.y, rect.w + 1, rect.h + 1 });
+    }
+    for (auto i = 0u; i < rects.size(); ++i)
+      for (auto j = i + 1; j < rects.size(); ++j)
+        if (overlapping(rects[i], rects[j]))
+          FAIL("sprites overlap");
+  }
+  for (const auto& sprite : sprites)
+    CHECK(sprite.slice_index >= 0);
+
+  // seams of a single slice are closed, sliding them again
+  // hardly moves any sprites
+  sheet->max_width = 0;
+  sheet->max_height = 0;
+  sprites = generate_sprites(sheet, sizes);
+  auto single_slices = pack_sprites(sprites);
+  REQUIRE(single_slices.size() == 1);
+  auto& slice = single_slices[0];
+  const auto area = slice.width * slice.height;
+  const auto positions = [&]() {
+    auto positions = std::vector<Point>();
+    for (const auto& sprite : slice.sprites)
+      positions.push_back(sprite.rect.xy());
+    return positions;
+  };
+  const auto packed = positions();
+  slide_sprites_up_left(slice);
+  recompute_slice_size(slice);
+  CHECK(slice.width * slice.height == area);
+  const auto slid = positions();
+  CHECK(std::inner_product(packed.begin(), packed.end(), slid.begin(), size_t{ },
+    std::plus<>(), std::not_equal_to<>()) < packed.size() / 20);
+}
+
+TEST_CASE("packing - Slide sprites") {
+  auto sheet = std::make_shared<Sheet>();
+  sheet->shape_padding = 1;
+  sheet->border_padding = 2;
+
+  // sprites with gaps between them
+  auto sizes = std::vector<rect_pack::Size>();
+  for (auto i = 0; i < 100; ++i)
+    sizes.push_back({ i, 10, 10 });
+  auto sprites = generate_sprites(sheet, sizes);
+  for (auto& sprite : sprites) {
+    sprite.size = { 10, 10 };
+    sprite.slice_index = 0;
+    sprite.rect = { 2 + (sprite.index % 10) * 15 + sprite.index % 3,
+      2 + (sprite.index / 10) * 14, 10, 10 };
+  }
+  auto slice = Slice{ sheet, 0, SpriteSpan(sprites) };
+  recompute_slice_size(slice);
+  const auto area = slice.width * slice.height;
+
+  slide_sprites_up_left(slice);
+  recompute_slice_size(slice);
+  CHECK(slice.width * slice.height < area);
+  CHECK(slice.width == 2 + 10 * 11 - 1 + 2);
+  CHECK(slice.height == 2 + 10 * 11 - 1 + 2);
+  for (const auto& a : sprites) {
+    CHECK(a.rect.x >= 2);
+    CHECK(a.rect.y >= 2);
+    for (const auto& b : sprites)
+      if (&a != &b)
+        CHECK(!overlapping({ a.rect.x, a.rect.y, 11, 11 },
+          { b.rect.x, b.rect.y, 11, 11 }));
+  }
+}
+
+TEST_CASE("packing - Polygon") {
+  auto slice = pack_single_sheet(R"(
+    sheet "sprites"
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  const auto width = slice.width;
+  const auto height = slice.height;
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack polygon
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+  )");
+  CHECK(le_size(slice, width, height));
+
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack polygon
+      allow-rotate
+      max-width 64
+    input "test/Items.png"
+      colorkey
+      atlas
+      trim convex
+  )");
+  CHECK(slice.width <= 64);
+
+  // without outline it packs rectangles
+  slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack polygon
+      padding 1
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  for (const auto& a : slice.sprites)
+    for (const auto& b : slice.sprites)
+      if (&a != &b)
+        CHECK(!overlapping(a.rect, b.rect));
+}
+
+TEST_CASE("packing - Grid") {
+  auto slice = pack_single_sheet(R"(
+    sheet "sprites"
+      pack grid
+      padding 1
+    input "test/Items.png"
+      colorkey
+      atlas
+  )");
+  CHECK(slice.sprites.size() > 1);
+  for (const auto& a : slice.sprites)
+    for (const auto& b : slice.sprites)
+      if (&a != &b)
+        CHECK(!overlapping(a.rect, b.rect));
+
+  // uniform sizes are laid out in a grid, also by binpack
+  auto sheet = std::make_shared<Sheet>();
+  sheet->pack = Pack::binpack;
+  sheet->max_width = 256;
+  sheet->max_height = 256;
+  sheet->shape_padding = 1;
+  sheet->border_padding = 2;
+
+  auto sizes = std::vector<rect_pack::Size>();
+  for (auto i = 0; i < 2000; ++i)
+    sizes.push_back({ i, 15, 15 });
+  auto sprites = generate_sprites(sheet, sizes);
+  const auto slices = pack_sprites(sprites);
+  REQUIRE(slices.size() == 9);
+  for (const auto& slice : slices) {
+    CHECK(slice.width <= 256);
+    CHECK(slice.height <= 256);
+    for (const auto& sprite : slice.sprites) {
+      CHECK((sprite.rect.x - 2) % 16 == 0);
+      CHECK((sprite.rect.y - 2) % 16 == 0);
+      CHECK(sprite.rect.x1() <= slice.width - 2);
+      CHECK(sprite.rect.y1() <= slice.height - 2);
+    }
+  }
+  for (const auto& sprite : sprites)
+    CHECK(sprite.slice_index >= 0);
+
+  // capacity of unlimited sheet exceeds int
+  for (auto pack : { Pack::grid, Pack::binpack }) {
+    auto huge_sheet = std::make_shared<Sheet>();
+    huge_sheet->pack = pack;
+    sizes.clear();
+    for (auto i = 0; i < 50000; ++i)
+      sizes.push_back({ i, 4, 4 });
+    sprites = generate_sprites(huge_sheet, sizes);
+    const auto huge_slices = pack_sprites(sprites);
+    REQUIRE(huge_slices.size() == 1);
+    CHECK(huge_slices[0].sprites.size() == sprites.size());
+    CHECK(std::all_of(sprites.begin(), sprites.end(),
+      [](const Sprite& sprite) { return sprite.slice_index == 0; }));
+  }
+}
+
+TEST_CASE("packing - Source cache") {
+  const auto definition = R"(
+    sheet "sprites"
+      allow-rotate true
+      duplicates share
+    input "test/Items.png"
+      colorkey
+      atlas
+  )";
+  const auto reference = get_slice_image(pack_single_sheet(definition));
+
+  // images are evicted on next decode, unless they are pinned
+  source_cache.set_memory_limit(1);
+  const auto expected = load_image("test/Items.png");
+  auto files = std::vector<std::shared_ptr<ImageFile>>();
+  for (auto i = 0; i < 3; ++i) {
+    const auto& file = files.emplace_back(
+      std::make_shared<ImageFile>("test", "Items.png"));
+    const auto pin = file->pin();
+    CHECK(is_identical(file->image(), file->rect(), expected, expected.rect()));
+    CHECK(source_cache.decoded_bytes() == expected.size_bytes());
+  }
+  {
+    const auto pin_0 = files[0]->pin();
+    const auto pin_1 = files[1]->pin();
+    CHECK(is_identical(files[0]->image(), files[0]->rect(),
+      expected, expected.rect()));
+    CHECK(is_identical(files[1]->image(), files[1]->rect(),
+      expected, expected.rect()));
+    CHECK(source_cache.decoded_bytes() == 2 * expected.size_bytes());
+  }
+  files.clear();
+  CHECK(source_cache.decoded_bytes() == 0);
+
+  const auto slice = pack_single_sheet(definition);
+  const auto image = get_slice_image(slice);
+  CHECK(is_identical(image, image.rect(), reference, reference.rect()));
+  source_cache.set_memory_limit(0);
+}
+
+TEST_CASE("packing - Decode sources") {
+  auto definition = std::string("sheet \"sprites\"\n");
+  for (auto i = 0; i < 4; ++i) {
+    const auto filename = std::filesystem::temp_directory_path() /
+      ("spright-test-decode-" + std::to_string(i) + ".png");
+    std::filesystem::copy_file("test/Items.png", filename,
+      std::filesystem::copy_options::overwrite_existing);
+    definition += "input \"" + path_to_utf8(filename) + "\"\n  trim rect\n";
+  }
+  auto input = std::stringstream(definition);
+  auto parser = InputParser(Settings{ });
+  parser.parse(input);
+  auto sprites = std::move(parser).sprites();
+
+  // sources bigger than the bound are still decoded, one after another
+  source_cache.set_memory_limit(std::numeric_limits<size_t>::max());
+  const auto decoded_bytes = source_cache.decoded_bytes();
+  decode_sources(sprites, 1);
+  const auto expected = load_image("test/Items.png");
+  CHECK(source_cache.decoded_bytes() - decoded_bytes ==
+    4 * expected.size_bytes());
+  for (const auto& sprite : sprites) {
+    const auto pin = sprite.source->pin();
+    CHECK(is_identical(sprite.source->image(), sprite.source->rect(),
+      expected, expected.rect()));
+  }
+
+  // sources beyond the memory limit are decoded in later waves
+  source_cache.set_memory_limit(2 * expected.size_bytes());
+  const auto waves = get_source_waves(sprites);
+  CHECK(waves.size() == 2);
+  auto wave_sprites = size_t{ };
+  for (const auto& wave : waves) {
+    CHECK(wave.data() == sprites.data() + wave_sprites);
+    wave_sprites += wave.size();
+  }
+  CHECK(wave_sprites == sprites.size());
+
+  source_cache.set_memory_limit(0);
+  CHECK(get_source_waves(sprites).size() == 1);
+}
+
+TEST_CASE("packing - Transform filtered output") {
+  // transparent border, rotation background is guessed after filtering
+  auto image = Image(24, 16, RGBA{ 10, 20, 30, 0 });
+  fill_rect(image, { 4, 4, 16, 8 }, RGBA{ 200, 100, 50, 255 });
+  const auto transforms = std::vector<TransformPtr>{
+    std::make_shared<Transform>(Transform{ TransformRotate{ 45, RotateMethod::bilinear } }),
+  };
+  for (auto filter : { PixelFilter::make_opaque, PixelFilter::colorkey,
+                       PixelFilter::clear_alpha }) {
+    const auto color = RGBA{ 1, 2, 3, 255 };
+    const auto output = transform_output(clone_image(image), transforms,
+      filter, color);
+    const auto output_rgba = output.view<RGBA>();
+    CHECK(std::all_of(output_rgba.values(), output_rgba.values() +
+      output_rgba.size(), [](const RGBA& color) { return color.a == 255; }));
+  }
+}